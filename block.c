@@ -0,0 +1,424 @@
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "codec.h"
+#include "block.h"
+
+/* the compressed segment permissions */
+#define BLOCK_FILE_PERMISSIONS (0644)
+
+/* the blocks of a segment decompressed concurrently */
+typedef struct {
+	block_segment_t *segment;
+	size_t next;
+	size_t last;
+	bool is_failed;
+} job_t;
+
+static bool _write_block(const int fd,
+                         const char *source,
+                         const size_t size,
+                         char *output,
+                         block_entry_t *entry) {
+	/* the compressed block */
+	const char *block = output;
+
+	/* the compressed block length */
+	size_t length = 0;
+
+	/* keep blocks which do not shrink as they are */
+	length = lz_compress(source, size, output, size - 1);
+	if (0 == length) {
+		block = source;
+		length = size;
+	}
+
+	entry->length = (uint32_t) length;
+	entry->size = (uint32_t) size;
+	return ((ssize_t) length == pwrite(fd,
+	                                   block,
+	                                   length,
+	                                   (off_t) entry->offset));
+}
+
+bool block_compress(const char *path) {
+	/* the temporary path */
+	char temporary_path[PATH_MAX] = {'\0'};
+
+	/* the segment header */
+	char magic[BLOCK_MAGIC_SIZE] = {'\0'};
+
+	/* the segment attributes */
+	struct stat attributes = {0};
+
+	/* the compressed segment header */
+	block_header_t header = {0};
+
+	/* the block index */
+	block_entry_t *entries = NULL;
+
+	/* the segment contents */
+	const char *contents = NULL;
+
+	/* a compressed block */
+	char *output = NULL;
+
+	/* the size of the current block */
+	size_t size = 0;
+
+	/* the offset of the next block */
+	uint64_t offset = 0;
+
+	/* a loop index */
+	uint32_t i = 0;
+
+	/* the return value */
+	bool result = false;
+
+	/* the segment */
+	int fd = -1;
+
+	/* the compressed segment */
+	int temporary_fd = -1;
+
+	assert(NULL != path);
+
+	if (sizeof(temporary_path) <= snprintf(temporary_path,
+	                                       sizeof(temporary_path),
+	                                       BLOCK_TEMPORARY_FORMAT,
+	                                       path)) {
+		goto end;
+	}
+
+	/* delete a compressed segment left behind by a crash, so it is never
+	 * mistaken for this one */
+	if ((-1 == unlink(temporary_path)) && (ENOENT != errno)) {
+		goto end;
+	}
+
+	/* if the segment is empty, or compressed already, there is nothing to
+	 * do */
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (-1 == fd) {
+		goto end;
+	}
+	if (-1 == fstat(fd, &attributes)) {
+		goto close_segment;
+	}
+	if (0 == attributes.st_size) {
+		result = true;
+		goto close_segment;
+	}
+	contents = mmap(NULL,
+	                (size_t) attributes.st_size,
+	                PROT_READ,
+	                MAP_PRIVATE,
+	                fd,
+	                0);
+	if (MAP_FAILED == contents) {
+		goto close_segment;
+	}
+	if (true == block_is_compressed(contents, (size_t) attributes.st_size)) {
+		result = true;
+		goto unmap;
+	}
+
+	header.size = (uint64_t) attributes.st_size;
+	header.block_size = BLOCK_SIZE;
+	header.count = (uint32_t) ((header.size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+	entries = calloc(header.count, sizeof(block_entry_t));
+	if (NULL == entries) {
+		goto unmap;
+	}
+	output = malloc(BLOCK_SIZE);
+	if (NULL == output) {
+		goto free_entries;
+	}
+
+	temporary_fd = open(temporary_path,
+	                    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+	                    BLOCK_FILE_PERMISSIONS);
+	if (-1 == temporary_fd) {
+		goto free_output;
+	}
+
+	/* compress each block independently, after the header and the index; the
+	 * segment is encoded, so blocks are compressed without decoding them */
+	offset = sizeof(magic) +
+	         sizeof(header) +
+	         ((uint64_t) header.count * sizeof(block_entry_t));
+	for ( ; header.count > i; ++i) {
+		size = BLOCK_SIZE;
+		if ((header.size - ((uint64_t) i * BLOCK_SIZE)) < size) {
+			size = (size_t) (header.size - ((uint64_t) i * BLOCK_SIZE));
+		}
+		entries[i].offset = offset;
+		if (false == _write_block(temporary_fd,
+		                          &contents[(size_t) i * BLOCK_SIZE],
+		                          size,
+		                          output,
+		                          &entries[i])) {
+			goto delete_temporary;
+		}
+		offset += entries[i].length;
+	}
+
+	/* write the header and the index, once the blocks are written */
+	codec_xor(magic, BLOCK_MAGIC, sizeof(magic));
+	if ((sizeof(magic) != pwrite(temporary_fd, magic, sizeof(magic), 0)) ||
+	    (sizeof(header) != pwrite(temporary_fd,
+	                              &header,
+	                              sizeof(header),
+	                              sizeof(magic))) ||
+	    ((ssize_t) (header.count * sizeof(block_entry_t)) !=
+	     pwrite(temporary_fd,
+	            entries,
+	            header.count * sizeof(block_entry_t),
+	            sizeof(magic) + sizeof(header)))) {
+		goto delete_temporary;
+	}
+
+	/* replace the segment only once the compressed one reaches the disk, so
+	 * one of them survives a crash */
+	if ((0 != fdatasync(temporary_fd)) ||
+	    (-1 == rename(temporary_path, path))) {
+		goto delete_temporary;
+	}
+	result = true;
+	goto close_temporary;
+
+delete_temporary:
+	(void) unlink(temporary_path);
+
+close_temporary:
+	(void) close(temporary_fd);
+
+free_output:
+	free(output);
+
+free_entries:
+	free(entries);
+
+unmap:
+	(void) munmap((void *) contents, (size_t) attributes.st_size);
+
+close_segment:
+	(void) close(fd);
+
+end:
+	return result;
+}
+
+bool block_is_compressed(const char *contents, const size_t size) {
+	/* the segment header */
+	char magic[BLOCK_MAGIC_SIZE] = {'\0'};
+
+	assert(NULL != contents);
+
+	if (sizeof(magic) > size) {
+		return false;
+	}
+
+	codec_xor(magic, contents, sizeof(magic));
+	return (0 == memcmp(magic, BLOCK_MAGIC, sizeof(magic)));
+}
+
+bool block_open(block_segment_t *segment,
+                const char *contents,
+                const size_t size) {
+	/* the compressed segment header */
+	block_header_t header = {0};
+
+	/* the size of the header and the index */
+	size_t index_end = 0;
+
+	/* a loop index */
+	size_t i = 0;
+
+	assert(NULL != segment);
+	assert(NULL != contents);
+
+	/* make sure the header and the index are complete */
+	if ((BLOCK_MAGIC_SIZE + sizeof(header)) > size) {
+		return false;
+	}
+	(void) memcpy(&header, &contents[BLOCK_MAGIC_SIZE], sizeof(header));
+	if ((BLOCK_SIZE != header.block_size) ||
+	    (0 == header.size) ||
+	    (SIZE_MAX < header.size) ||
+	    (((header.size + BLOCK_SIZE - 1) / BLOCK_SIZE) != header.count)) {
+		return false;
+	}
+	index_end = BLOCK_MAGIC_SIZE +
+	            sizeof(header) +
+	            ((size_t) header.count * sizeof(block_entry_t));
+	if (index_end > size) {
+		return false;
+	}
+
+	segment->contents = contents;
+	segment->entries = (const block_entry_t *)
+	                   &contents[BLOCK_MAGIC_SIZE + sizeof(header)];
+	segment->size = (size_t) header.size;
+	segment->count = (size_t) header.count;
+
+	/* make sure all blocks are inside the segment, so a corrupt index is
+	 * detected before anything is decompressed */
+	for ( ; segment->count > i; ++i) {
+		if ((index_end > segment->entries[i].offset) ||
+		    (size < segment->entries[i].offset) ||
+		    ((size - segment->entries[i].offset) <
+		     segment->entries[i].length) ||
+		    (segment->entries[i].size < segment->entries[i].length) ||
+		    (((segment->size - (i * BLOCK_SIZE)) < BLOCK_SIZE) ?
+		     ((segment->size - (i * BLOCK_SIZE)) !=
+		      segment->entries[i].size) :
+		     (BLOCK_SIZE != segment->entries[i].size))) {
+			return false;
+		}
+	}
+
+	/* blocks are decompressed into their original positions, on demand;
+	 * pages of blocks which are not decompressed are never allocated */
+	segment->is_decompressed = calloc(segment->count, sizeof(bool));
+	if (NULL == segment->is_decompressed) {
+		return false;
+	}
+	segment->data = mmap(NULL,
+	                     segment->size,
+	                     PROT_READ | PROT_WRITE,
+	                     MAP_PRIVATE | MAP_ANONYMOUS,
+	                     -1,
+	                     0);
+	if (MAP_FAILED == segment->data) {
+		free(segment->is_decompressed);
+		return false;
+	}
+
+	return true;
+}
+
+void block_close(block_segment_t *segment) {
+	assert(NULL != segment);
+
+	(void) munmap(segment->data, segment->size);
+	free(segment->is_decompressed);
+}
+
+static bool _decompress_block(block_segment_t *segment, const size_t i) {
+	/* the block index entry */
+	const block_entry_t *entry = &segment->entries[i];
+
+	/* the block position */
+	char *block = &segment->data[i * BLOCK_SIZE];
+
+	if (entry->length == entry->size) {
+		(void) memcpy(block, &segment->contents[entry->offset], entry->size);
+		return true;
+	}
+
+	return lz_decompress(&segment->contents[entry->offset],
+	                     entry->length,
+	                     block,
+	                     entry->size);
+}
+
+static void *_decompress(void *arg) {
+	/* the decompressed blocks */
+	job_t *job = (job_t *) arg;
+
+	/* the current block */
+	size_t i = 0;
+
+	assert(NULL != job);
+
+	/* take blocks one at a time, until none are left */
+	do {
+		i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+		if (job->last <= i) {
+			break;
+		}
+		if (true == job->segment->is_decompressed[i]) {
+			continue;
+		}
+		if (false == _decompress_block(job->segment, i)) {
+			__atomic_store_n(&job->is_failed, true, __ATOMIC_RELAXED);
+			break;
+		}
+		job->segment->is_decompressed[i] = true;
+	} while (1);
+
+	return NULL;
+}
+
+bool block_decompress(block_segment_t *segment,
+                      const size_t start,
+                      const size_t end) {
+	/* the decompressing threads */
+	pthread_t threads[MAX_BLOCK_THREADS] = {0};
+
+	/* the decompressed blocks */
+	job_t job = {0};
+
+	/* the number of decompressing threads */
+	long processors = 0;
+
+	/* the number of started threads */
+	long started = 0;
+
+	/* the number of blocks not decompressed yet */
+	size_t pending = 0;
+
+	/* a loop index */
+	size_t i = 0;
+
+	assert(NULL != segment);
+	assert(start <= end);
+	assert(segment->size >= end);
+
+	/* decompress only the blocks which overlap the range */
+	job.segment = segment;
+	job.next = start / BLOCK_SIZE;
+	job.last = (end + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	for (i = job.next; job.last > i; ++i) {
+		if (false == segment->is_decompressed[i]) {
+			++pending;
+		}
+	}
+	if (0 == pending) {
+		return true;
+	}
+
+	/* decompress them using all processors */
+	processors = sysconf(_SC_NPROCESSORS_ONLN);
+	if (1 > processors) {
+		processors = 1;
+	} else if (MAX_BLOCK_THREADS < processors) {
+		processors = MAX_BLOCK_THREADS;
+	}
+	if (pending < (size_t) processors) {
+		processors = (long) pending;
+	}
+	for (started = 1; processors > started; ++started) {
+		if (0 != pthread_create(&threads[started], NULL, _decompress, &job)) {
+			break;
+		}
+	}
+	(void) _decompress(&job);
+	while (1 < started) {
+		--started;
+		(void) pthread_join(threads[started], NULL);
+	}
+
+	return (false == job.is_failed);
+}
@@ -0,0 +1,65 @@
+#ifndef _BLOCK_H_INCLUDED
+#	define _BLOCK_H_INCLUDED
+
+#	include <stdint.h>
+#	include <stdbool.h>
+#	include <sys/types.h>
+
+#	include "common.h"
+#	include "lz.h"
+
+/* the header of compressed log segments */
+#	define BLOCK_MAGIC "LOGBLK1\n"
+
+/* the size of the header of compressed log segments */
+#	define BLOCK_MAGIC_SIZE (STRLEN(BLOCK_MAGIC))
+
+/* the size of the blocks log segments are compressed in */
+#	define BLOCK_SIZE (LZ_MAX_SIZE)
+
+/* the path format of a log segment while it is compressed */
+#	define BLOCK_TEMPORARY_FORMAT "%s.tmp"
+
+/* the maximum number of threads decompressing a log segment */
+#	define MAX_BLOCK_THREADS (64)
+
+/* the size of the original segment and the number of blocks, which follow
+ * the magic */
+typedef struct {
+	uint64_t size;
+	uint32_t block_size;
+	uint32_t count;
+} block_header_t;
+
+/* a block index entry, which follows the header; if the block was not
+ * compressed, its length is its size */
+typedef struct {
+	uint64_t offset;
+	uint32_t length;
+	uint32_t size;
+} block_entry_t;
+
+/* a mapped compressed segment; blocks are decompressed into data, once */
+typedef struct {
+	const char *contents;
+	const block_entry_t *entries;
+	char *data;
+	bool *is_decompressed;
+	size_t size;
+	size_t count;
+} block_segment_t;
+
+bool block_compress(const char *path);
+
+bool block_is_compressed(const char *contents, const size_t size);
+
+bool block_open(block_segment_t *segment,
+                const char *contents,
+                const size_t size);
+void block_close(block_segment_t *segment);
+
+bool block_decompress(block_segment_t *segment,
+                      const size_t start,
+                      const size_t end);
+
+#endif
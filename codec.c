@@ -0,0 +1,156 @@
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#	include <immintrin.h>
+#elif defined(__ARM_NEON)
+#	include <arm_neon.h>
+#endif
+
+#include "common.h"
+#include "syslog.h"
+#include "codec.h"
+
+/* the log XOR key, repeated across a machine word */
+#define XOR_WORD ((uint64_t) XOR_KEY * UINT64_C(0x0101010101010101))
+
+static void _xor_words(char *destination, const char *source, size_t size) {
+	/* a machine word */
+	uint64_t word = 0;
+
+	/* XOR a machine word at a time; memcpy() avoids unaligned access and is
+	 * optimized away */
+	for ( ; sizeof(word) <= size; size -= sizeof(word)) {
+		(void) memcpy(&word, source, sizeof(word));
+		word ^= XOR_WORD;
+		(void) memcpy(destination, &word, sizeof(word));
+		source += sizeof(word);
+		destination += sizeof(word);
+	}
+
+	/* XOR the remaining bytes */
+	for ( ; 0 < size; --size) {
+		*destination = *source ^ XOR_KEY;
+		++source;
+		++destination;
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("sse2")))
+static void _xor_sse2(char *destination, const char *source, size_t size) {
+	/* the XOR key, repeated across a vector */
+	const __m128i key = _mm_set1_epi8((char) XOR_KEY);
+
+	/* a block of the source */
+	__m128i block = _mm_setzero_si128();
+
+	for ( ; sizeof(key) <= size; size -= sizeof(key)) {
+		block = _mm_loadu_si128((const __m128i *) source);
+		_mm_storeu_si128((__m128i *) destination, _mm_xor_si128(block, key));
+		source += sizeof(key);
+		destination += sizeof(key);
+	}
+
+	_xor_words(destination, source, size);
+}
+
+__attribute__((target("avx2")))
+static void _xor_avx2(char *destination, const char *source, size_t size) {
+	/* the XOR key, repeated across a vector */
+	const __m256i key = _mm256_set1_epi8((char) XOR_KEY);
+
+	/* a block of the source */
+	__m256i block = _mm256_setzero_si256();
+
+	for ( ; sizeof(key) <= size; size -= sizeof(key)) {
+		block = _mm256_loadu_si256((const __m256i *) source);
+		_mm256_storeu_si256((__m256i *) destination,
+		                    _mm256_xor_si256(block, key));
+		source += sizeof(key);
+		destination += sizeof(key);
+	}
+
+	_xor_words(destination, source, size);
+}
+
+#elif defined(__ARM_NEON)
+
+static void _xor_neon(char *destination, const char *source, size_t size) {
+	/* the XOR key, repeated across a vector */
+	const uint8x16_t key = vdupq_n_u8((uint8_t) XOR_KEY);
+
+	for ( ; sizeof(key) <= size; size -= sizeof(key)) {
+		vst1q_u8((uint8_t *) destination,
+		         veorq_u8(vld1q_u8((const uint8_t *) source), key));
+		source += sizeof(key);
+		destination += sizeof(key);
+	}
+
+	_xor_words(destination, source, size);
+}
+
+#endif
+
+static bool _is_always_supported(void) {
+	return true;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+static bool _is_avx2_supported(void) {
+	__builtin_cpu_init();
+	return (0 != __builtin_cpu_supports("avx2"));
+}
+
+static bool _is_sse2_supported(void) {
+	__builtin_cpu_init();
+	return (0 != __builtin_cpu_supports("sse2"));
+}
+
+#endif
+
+/* all implementations, from the fastest to the slowest */
+static const codec_implementation_t implementations[] = {
+#if defined(__x86_64__) || defined(__i386__)
+	{"avx2", _xor_avx2, _is_avx2_supported},
+	{"sse2", _xor_sse2, _is_sse2_supported},
+#elif defined(__ARM_NEON)
+	{"neon", _xor_neon, _is_always_supported},
+#endif
+	{"words", _xor_words, _is_always_supported}
+};
+
+/* the fastest implementation supported by the CPU */
+static void (*xor_function)(char *, const char *, size_t) = _xor_words;
+
+/* pick the implementation before main() and before any thread is started,
+ * so codec_xor() never writes it */
+__attribute__((constructor))
+static void _select(void) {
+	/* a loop index */
+	size_t i = 0;
+
+	for ( ; ARRAY_SIZE(implementations) > i; ++i) {
+		if (true == implementations[i].is_supported()) {
+			xor_function = implementations[i].function;
+			return;
+		}
+	}
+}
+
+void codec_xor(char *destination, const char *source, const size_t size) {
+	assert(NULL != destination);
+	assert(NULL != source);
+
+	xor_function(destination, source, size);
+}
+
+const codec_implementation_t *codec_get_implementations(size_t *count) {
+	assert(NULL != count);
+
+	*count = ARRAY_SIZE(implementations);
+	return implementations;
+}
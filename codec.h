@@ -0,0 +1,18 @@
+#ifndef _CODEC_H_INCLUDED
+#	define _CODEC_H_INCLUDED
+
+#	include <stdbool.h>
+#	include <sys/types.h>
+
+/* an implementation of codec_xor() */
+typedef struct {
+	const char *name;
+	void (*function)(char *destination, const char *source, size_t size);
+	bool (*is_supported)(void);
+} codec_implementation_t;
+
+void codec_xor(char *destination, const char *source, const size_t size);
+
+const codec_implementation_t *codec_get_implementations(size_t *count);
+
+#endif
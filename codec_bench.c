@@ -0,0 +1,101 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "codec.h"
+
+/* the size of the encoded buffer, like a full writer buffer */
+#define BENCH_SIZE (64 * 1024)
+
+/* the number of times the buffer is encoded by each implementation */
+#define BENCH_ROUNDS (20000)
+
+/* the size of a typical message, encoded on its own */
+#define BENCH_MESSAGE_SIZE (100)
+
+static double _measure(void (*function)(char *, const char *, size_t),
+                       char *destination,
+                       const char *source,
+                       const size_t size,
+                       const unsigned int rounds) {
+	/* the start and end times */
+	struct timespec start = {0};
+	struct timespec end = {0};
+
+	/* a loop index */
+	unsigned int i = 0;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &start);
+	for ( ; rounds > i; ++i) {
+		function(destination, source, size);
+		__asm__ __volatile__("" : : "r" (destination) : "memory");
+	}
+	(void) clock_gettime(CLOCK_MONOTONIC, &end);
+
+	/* return the throughput, in megabytes per second */
+	return ((double) size * (double) rounds / (1024.0 * 1024.0)) /
+	       ((double) (end.tv_sec - start.tv_sec) +
+	        ((double) (end.tv_nsec - start.tv_nsec) / 1e9));
+}
+
+int main(int argc, char *argv[]) {
+	/* the implementations */
+	const codec_implementation_t *implementations = NULL;
+
+	/* the buffers */
+	char *source = NULL;
+	char *destination = NULL;
+
+	/* the number of implementations */
+	size_t count = 0;
+
+	/* a loop index */
+	size_t i = 0;
+
+	/* the exit code */
+	int exit_code = EXIT_FAILURE;
+
+	source = malloc(BENCH_SIZE);
+	if (NULL == source) {
+		goto end;
+	}
+	destination = malloc(BENCH_SIZE);
+	if (NULL == destination) {
+		goto free_source;
+	}
+	for (i = 0; BENCH_SIZE > i; ++i) {
+		source[i] = (char) (i * 31);
+	}
+
+	/* compare all implementations supported by the CPU, with full buffers and
+	 * with single messages */
+	implementations = codec_get_implementations(&count);
+	for (i = 0; count > i; ++i) {
+		if (false == implementations[i].is_supported()) {
+			(void) printf("%-8s unsupported\n", implementations[i].name);
+			continue;
+		}
+		(void) printf("%-8s %10.1f MB/s %10.1f MB/s\n",
+		              implementations[i].name,
+		              _measure(implementations[i].function,
+		                       destination,
+		                       source,
+		                       BENCH_SIZE,
+		                       BENCH_ROUNDS),
+		              _measure(implementations[i].function,
+		                       destination,
+		                       source,
+		                       BENCH_MESSAGE_SIZE,
+		                       BENCH_ROUNDS * 100));
+	}
+	exit_code = EXIT_SUCCESS;
+
+	free(destination);
+
+free_source:
+	free(source);
+
+end:
+	return exit_code;
+}
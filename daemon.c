@@ -7,6 +7,7 @@
 #include <sched.h>
 #include <pwd.h>
 #include <assert.h>
+#include <errno.h>
 
 #include "daemon.h"
 
@@ -138,13 +139,17 @@ bool daemon_init(daemon_t *daemon,
 	/* pick the minimum real-time signal */
 	daemon->io_signal = SIGRTMIN;
 
-	/* block io_signal, SIGCHLD and SIGTERM signals */
+	/* block io_signal, SIGIO and SIGTERM signals; SIGIO is sent instead of
+	 * io_signal when the real-time signal queue overflows */
 	if (-1 == sigemptyset(&daemon->signal_mask)) {
 		goto end;
 	}
 	if (-1 == sigaddset(&daemon->signal_mask, daemon->io_signal)) {
 		goto end;
 	}
+	if (-1 == sigaddset(&daemon->signal_mask, SIGIO)) {
+		goto end;
+	}
 	if (-1 == sigaddset(&daemon->signal_mask, SIGTERM)) {
 		goto end;
 	}
@@ -162,26 +167,46 @@ bool daemon_init(daemon_t *daemon,
 		goto end;
 	}
 
+	/* enable non-blocking I/O */
+	if (-1 == fcntl(daemon->fd, F_SETFL, flags | O_NONBLOCK)) {
+		goto end;
+	}
+
+	/* enable asynchronous I/O */
+	result = daemon_watch(daemon, daemon->fd);
+
+end:
+	return result;
+}
+
+bool daemon_watch(const daemon_t *daemon, const int fd) {
+	/* the file descriptor flags */
+	int flags = 0;
+
+	assert(NULL != daemon);
+
+	/* get the file descriptor flags */
+	flags = fcntl(fd, F_GETFL);
+	if (-1 == flags) {
+		return false;
+	}
+
 	/* set the file descriptor I/O signal */
-	if (-1 == fcntl(daemon->fd, F_SETSIG, daemon->io_signal)) {
- 		goto end;
+	if (-1 == fcntl(fd, F_SETSIG, daemon->io_signal)) {
+		return false;
 	}
 
-	/* enable non-blocking, asynchronous I/O */
-	if (-1 == fcntl(daemon->fd, F_SETFL, flags | O_NONBLOCK | O_ASYNC)) {
-		goto end;
+	/* enable asynchronous I/O */
+	if (-1 == fcntl(fd, F_SETFL, flags | O_ASYNC)) {
+		return false;
 	}
 
 	/* change the file descriptor ownership */
-	if (-1 == fcntl(daemon->fd, F_SETOWN, getpid())) {
-		goto end;
+	if (-1 == fcntl(fd, F_SETOWN, getpid())) {
+		return false;
 	}
 
-	/* report success */
-	result = true;
-
-end:
-	return result;
+	return true;
 }
 
 bool daemon_wait(const daemon_t *daemon, int *received_signal) {
@@ -192,6 +217,53 @@ bool daemon_wait(const daemon_t *daemon, int *received_signal) {
 		return false;
 	}
 
+	if (SIGIO == *received_signal) {
+		*received_signal = daemon->io_signal;
+	}
+
+	if ((daemon->io_signal != *received_signal) &&
+	    (SIGTERM != *received_signal)) {
+		return false;
+	}
+
+	return true;
+}
+
+bool daemon_timed_wait(const daemon_t *daemon,
+                       int *received_signal,
+                       const struct timespec *timeout,
+                       int *fd) {
+	/* the received signal information */
+	siginfo_t info = {0};
+
+	assert(NULL != daemon);
+	assert(NULL != received_signal);
+	assert(NULL != timeout);
+
+	/* if the file descriptor which is ready is unknown, report -1 */
+	if (NULL != fd) {
+		*fd = -1;
+	}
+
+	*received_signal = sigtimedwait(&daemon->signal_mask, &info, timeout);
+	if (-1 == *received_signal) {
+		if (EAGAIN != errno) {
+			return false;
+		}
+
+		/* report a timeout through a zero signal */
+		*received_signal = 0;
+		return true;
+	}
+
+	/* the real-time signal tells which file descriptor is ready; SIGIO,
+	 * which is sent once the real-time signal queue overflows, does not */
+	if (SIGIO == *received_signal) {
+		*received_signal = daemon->io_signal;
+	} else if ((daemon->io_signal == *received_signal) && (NULL != fd)) {
+		*fd = info.si_fd;
+	}
+
 	if ((daemon->io_signal != *received_signal) &&
 	    (SIGTERM != *received_signal)) {
 		return false;
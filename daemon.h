@@ -3,6 +3,7 @@
 
 #	include <stdbool.h>
 #	include <signal.h>
+#	include <time.h>
 
 #	define DAEMON_WORKING_DIRECTORY "/run"
 
@@ -18,7 +19,12 @@ bool daemon_init(daemon_t *daemon,
                  const char *working_directory,
                  const char *user);
 bool daemon_daemonize(const char *working_directory, const char *user);
+bool daemon_watch(const daemon_t *daemon, const int fd);
 bool daemon_wait(const daemon_t *daemon, int *received_signal);
+bool daemon_timed_wait(const daemon_t *daemon,
+                       int *received_signal,
+                       const struct timespec *timeout,
+                       int *fd);
 pid_t daemon_fork();
 
 #endif
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <syslog.h>
+#include <assert.h>
+
+#include "dedup.h"
+
+/* the report of repeated messages */
+#define REPORT_FORMAT "<%d>%s %.*s: last message repeated %u times"
+
+/* the timestamp format of the report */
+#define TIMESTAMP_FORMAT "%b %e %H:%M:%S"
+
+/* the FNV-1a offset basis and prime */
+#define FNV_OFFSET_BASIS (2166136261U)
+#define FNV_PRIME (16777619U)
+
+static uint32_t _hash(const char *data, size_t size) {
+	/* the hash */
+	uint32_t hash = FNV_OFFSET_BASIS;
+
+	for ( ; 0 < size; --size) {
+		hash = (hash ^ (unsigned char) *data) * FNV_PRIME;
+		++data;
+	}
+
+	return hash;
+}
+
+static size_t _get_source_length(const message_t *message) {
+	/* the end of the source */
+	const char *end = NULL;
+
+	/* the source is the tag and the process ID following it, if there is
+	 * one */
+	end = memchr(&message->text[message->tag_offset],
+	             ':',
+	             message->length - message->tag_offset);
+	if (NULL == end) {
+		return message->tag_length;
+	}
+
+	return (size_t) (end - &message->text[message->tag_offset]);
+}
+
+static void _report(const dedup_source_t *source, message_t *report) {
+	/* the report text */
+	char text[1 + MAX_MESSAGE_LENGTH] = {'\0'};
+
+	/* the report timestamp */
+	char timestamp[16] = {'\0'};
+
+	/* the current time */
+	struct tm now = {0};
+
+	/* the current time, in seconds since the epoch */
+	time_t seconds = 0;
+
+	/* the report length */
+	int length = 0;
+
+	seconds = time(NULL);
+	if ((NULL == localtime_r(&seconds, &now)) ||
+	    (0 == strftime(timestamp, sizeof(timestamp), TIMESTAMP_FORMAT, &now))) {
+		timestamp[0] = '\0';
+	}
+
+	/* report the repeated message with the same priority, as sent by the
+	 * same source */
+	length = snprintf(text,
+	                  sizeof(text),
+	                  REPORT_FORMAT,
+	                  (source->message.facility << 3) |
+	                  source->message.priority,
+	                  timestamp,
+	                  (int) _get_source_length(&source->message),
+	                  &source->message.text[source->message.tag_offset],
+	                  source->repeats);
+	if (sizeof(text) <= (size_t) length) {
+		length = sizeof(text) - 1;
+	}
+	message_init(report, text, (size_t) length);
+}
+
+static void _track(dedup_source_t *source,
+                   const message_t *message,
+                   const uint32_t hash) {
+	/* copy the message, up to the end of its text */
+	(void) memcpy(&source->message,
+	              message,
+	              offsetof(message_t, text) + message->length);
+	source->hash = hash;
+	source->repeats = 0;
+	source->is_used = true;
+}
+
+void dedup_init(dedup_t *dedup) {
+	/* a loop index */
+	unsigned int i = 0;
+
+	assert(NULL != dedup);
+
+	for (i = 0; DEDUP_SOURCES > i; ++i) {
+		dedup->sources[i].repeats = 0;
+		dedup->sources[i].is_used = false;
+	}
+}
+
+bool dedup_is_repeated(dedup_t *dedup,
+                       const message_t *message,
+                       message_t *report,
+                       bool *is_reported) {
+	/* the message source */
+	dedup_source_t *source = NULL;
+
+	/* the message body, which excludes the timestamp */
+	const char *body = NULL;
+
+	/* the body size */
+	size_t size = 0;
+
+	/* the body hash */
+	uint32_t hash = 0;
+
+	assert(NULL != dedup);
+	assert(NULL != message);
+	assert(NULL != report);
+	assert(NULL != is_reported);
+
+	*is_reported = false;
+
+	/* find the previous message of the same source */
+	body = &message->text[message->tag_offset];
+	size = message->length - message->tag_offset;
+	source = &dedup->sources[_hash(body, _get_source_length(message)) &
+	                         (DEDUP_SOURCES - 1)];
+	hash = _hash(body, size);
+
+	/* if the message is identical, count it instead of writing it; hashes
+	 * are compared first, since most messages are different */
+	if ((true == source->is_used) &&
+	    (hash == source->hash) &&
+	    (message->priority == source->message.priority) &&
+	    (message->facility == source->message.facility) &&
+	    (size == (source->message.length - source->message.tag_offset)) &&
+	    (0 == memcmp(body,
+	                 &source->message.text[source->message.tag_offset],
+	                 size))) {
+		/* report repeats only after a while, so they are not lost */
+		if (0 == source->repeats) {
+			source->deadline.tv_sec = message->monotonic.tv_sec +
+			                          DEDUP_DELAY;
+			source->deadline.tv_nsec = message->monotonic.tv_nsec;
+		}
+		++source->repeats;
+		return true;
+	}
+
+	/* otherwise, report repeats of the previous message before this one */
+	if ((true == source->is_used) && (0 < source->repeats)) {
+		_report(source, report);
+		*is_reported = true;
+	}
+
+	_track(source, message, hash);
+	return false;
+}
+
+bool dedup_expire(dedup_t *dedup, message_t *report, const bool is_forced) {
+	/* the current time */
+	struct timespec now = {0};
+
+	/* a loop index */
+	unsigned int i = 0;
+
+	assert(NULL != dedup);
+	assert(NULL != report);
+
+	if (-1 == clock_gettime(CLOCK_MONOTONIC, &now)) {
+		return false;
+	}
+
+	/* report repeats of one message, if it is time to */
+	for (i = 0; DEDUP_SOURCES > i; ++i) {
+		if ((0 == dedup->sources[i].repeats) ||
+		    ((false == is_forced) &&
+		     ((now.tv_sec < dedup->sources[i].deadline.tv_sec) ||
+		      ((now.tv_sec == dedup->sources[i].deadline.tv_sec) &&
+		       (now.tv_nsec < dedup->sources[i].deadline.tv_nsec))))) {
+			continue;
+		}
+
+		_report(&dedup->sources[i], report);
+		dedup->sources[i].repeats = 0;
+		return true;
+	}
+
+	return false;
+}
+
+bool dedup_get_timeout(const dedup_t *dedup, struct timespec *timeout) {
+	/* the current time */
+	struct timespec now = {0};
+
+	/* the earliest deadline */
+	const struct timespec *deadline = NULL;
+
+	/* a loop index */
+	unsigned int i = 0;
+
+	assert(NULL != dedup);
+	assert(NULL != timeout);
+
+	for (i = 0; DEDUP_SOURCES > i; ++i) {
+		if ((0 < dedup->sources[i].repeats) &&
+		    ((NULL == deadline) ||
+		     (deadline->tv_sec > dedup->sources[i].deadline.tv_sec) ||
+		     ((deadline->tv_sec == dedup->sources[i].deadline.tv_sec) &&
+		      (deadline->tv_nsec > dedup->sources[i].deadline.tv_nsec)))) {
+			deadline = &dedup->sources[i].deadline;
+		}
+	}
+
+	/* if no repeats are pending, there is no deadline */
+	if (NULL == deadline) {
+		return false;
+	}
+
+	/* calculate the time left until the deadline */
+	if (-1 == clock_gettime(CLOCK_MONOTONIC, &now)) {
+		timeout->tv_sec = 0;
+		timeout->tv_nsec = 0;
+		return true;
+	}
+	timeout->tv_sec = deadline->tv_sec - now.tv_sec;
+	timeout->tv_nsec = deadline->tv_nsec - now.tv_nsec;
+	if (0 > timeout->tv_nsec) {
+		--timeout->tv_sec;
+		timeout->tv_nsec += 1000000000L;
+	}
+	if (0 > timeout->tv_sec) {
+		timeout->tv_sec = 0;
+		timeout->tv_nsec = 0;
+	}
+
+	return true;
+}
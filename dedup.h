@@ -0,0 +1,38 @@
+#ifndef _DEDUP_H_INCLUDED
+#	define _DEDUP_H_INCLUDED
+
+#	include <stdint.h>
+#	include <stdbool.h>
+#	include <time.h>
+
+#	include "message.h"
+
+/* the number of message sources tracked; must be a power of 2 */
+#	define DEDUP_SOURCES (64)
+
+/* the maximum time, in seconds, repeated messages are not reported */
+#	define DEDUP_DELAY (30)
+
+typedef struct {
+	struct timespec deadline;
+	message_t message;
+	uint32_t hash;
+	unsigned int repeats;
+	bool is_used;
+} dedup_source_t;
+
+typedef struct {
+	dedup_source_t sources[DEDUP_SOURCES];
+} dedup_t;
+
+void dedup_init(dedup_t *dedup);
+
+bool dedup_is_repeated(dedup_t *dedup,
+                       const message_t *message,
+                       message_t *report,
+                       bool *is_reported);
+bool dedup_expire(dedup_t *dedup, message_t *report, const bool is_forced);
+
+bool dedup_get_timeout(const dedup_t *dedup, struct timespec *timeout);
+
+#endif
@@ -4,26 +4,329 @@
 #include <fcntl.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <sys/un.h>
+#include <limits.h>
+#include <time.h>
 #include <linux/netlink.h>
+#include <linux/filter.h>
 #include <assert.h>
 #include <string.h>
 #include <errno.h>
 #include <syslog.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <fnmatch.h>
 
 #include "common.h"
 #include "find.h"
 #include "daemon.h"
+#include "modprobed.h"
 
 /* the maximum size of a netlink message */
 #define MAX_MESSAGE_SIZE (sizeof(char) * (1 + MAX_LENGTH))
 
+/* the number of messages received at once */
+#define RING_SIZE (32)
+
+/* the netlink socket receiving buffer size */
+#define RECEIVE_BUFFER_SIZE (4 * 1024 * 1024)
+
+/* the netlink multicast group of kernel events */
+#define KERNEL_EVENTS (1)
+
+/* the number of latency histogram buckets; bucket i counts drivers loaded
+ * within less than 2^i milliseconds, while the last one counts the rest */
+#define LATENCY_BUCKETS (16)
+
+/* the maximum number of buses latency is measured for */
+#define MAX_BUSES (16)
+
+/* the maximum length of a bus name */
+#define MAX_BUS_LENGTH (15)
+
+/* the maximum number of driver loading requests awaiting completion */
+#define MAX_PENDING (64)
+
+/* the time, in seconds, after which a driver loading request is considered
+ * unanswered */
+#define REQUEST_TIMEOUT (60)
+
+/* the interval, in seconds, between statistics summaries */
+#define SUMMARY_INTERVAL (60)
+
+/* the timeout, in seconds, of driver loading requests */
+#define SEND_TIMEOUT (5)
+
+/* the window, in milliseconds, in which repeated events of a device are
+ * coalesced */
+#define COALESCE_WINDOW (500)
+
+/* the maximum number of devices events are rate-limited for */
+#define MAX_DEVICES (128)
+
+/* the maximum length of a device path kept for rate limiting; longer paths
+ * are told apart by their hash, too */
+#define MAX_DEVICE_PATH_LENGTH (255)
+
+/* the number of events a device may generate in a burst and the number of
+ * events per second it may generate afterwards */
+#define DEVICE_BURST (5)
+#define DEVICE_RATE (0.1)
+
+/* the number of repeated events all devices may generate in a burst and the
+ * number of such events per second they may generate afterwards */
+#define GLOBAL_BURST (50)
+#define GLOBAL_RATE (10)
+
+/* the coldplug priorities file path */
+#define PRIORITIES_PATH CONF_DIR"/devd.conf"
+
 /* the usage message */
 #define USAGE "Usage: devd\n"
 
-static bool _handle_existing_device(const char *path, void *unused) {
+/* coldplug priorities, by module alias pattern */
+typedef struct {
+	char **patterns;
+	unsigned int count;
+} priorities_t;
+
+/* an existing device */
+typedef struct {
+	char *alias;
+	unsigned int priority;
+} device_t;
+
+/* existing devices */
+typedef struct {
+	device_t *devices;
+	unsigned int count;
+} devices_t;
+
+/* driver loading latency statistics of a bus */
+typedef struct {
+	char name[1 + MAX_BUS_LENGTH];
+	unsigned int histogram[LATENCY_BUCKETS];
+	unsigned int failures;
+} bus_t;
+
+/* a driver loading request awaiting completion */
+typedef struct {
+	struct timespec received;
+	uint64_t seqnum;
+	bus_t *bus;
+	char name[1 + NAME_MAX];
+} request_t;
+
+/* event statistics */
+typedef struct {
+	bus_t buses[MAX_BUSES];
+	request_t pending[MAX_PENDING];
+	unsigned int bus_count;
+	unsigned int received;
+	unsigned int dropped;
+	unsigned int overflows;
+	unsigned int duplicates;
+	unsigned int unanswered;
+	unsigned int coalesced;
+	unsigned int throttled;
+	unsigned int unsent;
+	bool is_changed;
+} statistics_t;
+
+/* a token bucket */
+typedef struct {
+	struct timespec updated;
+	double tokens;
+} bucket_t;
+
+/* the events rate limiting state of a device */
+typedef struct {
+	bucket_t bucket;
+	struct timespec handled;
+	uint32_t hash;
+	bool is_used;
+	bool is_throttled;
+	char path[1 + MAX_DEVICE_PATH_LENGTH];
+} device_state_t;
+
+/* the events rate limiting state */
+typedef struct {
+	device_state_t devices[MAX_DEVICES];
+	bucket_t bucket;
+} storm_t;
+
+/* the daemon state */
+typedef struct {
+	daemon_t daemon;
+	priorities_t priorities;
+	statistics_t statistics;
+	storm_t storm;
+	struct sockaddr_un modprobed_address;
+	uint64_t last_seqnum;
+	int requests;
+	bool is_filtered;
+} devd_t;
+
+/* the default coldplug priorities: storage controllers first, then network
+ * controllers */
+static const char *g_default_priorities[] = {
+	"pci:*bc01*",
+	"virtio:d00000002v*",
+	"usb:*ic08*",
+	"pci:*bc02*",
+	"virtio:d00000001v*"
+};
+
+/* a socket filter which passes only "add@" events to user-space; classic BPF
+ * has no loops, so looking for MODALIAS= or DRIVER= is left to
+ * _handle_new_device() */
+static struct sock_filter g_filter[] = {
+	BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 0),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x61646440, 0, 1),
+	BPF_STMT(BPF_RET | BPF_K, 0xFFFFFFFF),
+	BPF_STMT(BPF_RET | BPF_K, 0)
+};
+
+static bool _request_module(const devd_t *devd,
+                            const char *alias,
+                            const int flags) {
+	/* the alias size */
+	size_t size = 0;
+
+	assert(NULL != devd);
+	assert(NULL != alias);
+
+	/* send the module alias to modprobed */
+	size = sizeof(char) * strlen(alias);
+	if ((ssize_t) size != sendto(devd->requests,
+	                             alias,
+	                             size,
+	                             flags,
+	                             (struct sockaddr *) &devd->modprobed_address,
+	                             sizeof(devd->modprobed_address))) {
+		return false;
+	}
+
+	return true;
+}
+
+static bool _run_modprobe(devd_t *devd, const char *alias) {
+	assert(NULL != devd);
+	assert(NULL != alias);
+
+	/* if modprobed cannot accept a request, e.g since it is not running yet
+	 * or is too slow, run modprobe instead, so the driver is loaded anyway */
+	++devd->statistics.unsent;
+	devd->statistics.is_changed = true;
+
+	switch (daemon_fork()) {
+		case 0:
+			(void) execlp("modprobe", "modprobe", alias, (char *) NULL);
+			exit(EXIT_FAILURE);
+
+		case (-1):
+			return false;
+	}
+
+	return true;
+}
+
+static bool _append_pattern(priorities_t *priorities, const char *pattern) {
+	/* the enlarged patterns array */
+	char **patterns = NULL;
+
+	assert(NULL != priorities);
+	assert(NULL != pattern);
+
+	/* enlarge the patterns array */
+	patterns = realloc(priorities->patterns,
+	                   sizeof(char *) * (1 + priorities->count));
+	if (NULL == patterns) {
+		return false;
+	}
+	priorities->patterns = patterns;
+
+	/* append the pattern */
+	patterns[priorities->count] = strdup(pattern);
+	if (NULL == patterns[priorities->count]) {
+		return false;
+	}
+	++priorities->count;
+
+	return true;
+}
+
+static bool _load_priorities(priorities_t *priorities) {
+	/* a line in the priorities file */
+	char line[1 + MAX_LENGTH] = {'\0'};
+
+	/* the priorities file */
+	FILE *file = NULL;
+
+	/* the line length */
+	size_t length = 0;
+
+	/* a loop index */
+	unsigned int i = 0;
+
+	assert(NULL != priorities);
+
+	/* open the priorities file; if it does not exist, use the defaults */
+	file = fopen(PRIORITIES_PATH, "r");
+	if (NULL == file) {
+		if (ENOENT != errno) {
+			return false;
+		}
+		for ( ; ARRAY_SIZE(g_default_priorities) > i; ++i) {
+			if (false == _append_pattern(priorities,
+			                             g_default_priorities[i])) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	while (NULL != fgets(line, sizeof(line), file)) {
+		/* strip the line break */
+		length = strlen(line);
+		if ((0 < length) && ('\n' == line[length - 1])) {
+			line[length - 1] = '\0';
+		}
+
+		/* skip empty lines and comments */
+		if (('\0' == line[0]) || ('#' == line[0])) {
+			continue;
+		}
+
+		if (false == _append_pattern(priorities, line)) {
+			(void) fclose(file);
+			return false;
+		}
+	}
+
+	(void) fclose(file);
+	return true;
+}
+
+static void _free_priorities(priorities_t *priorities) {
+	/* a loop index */
+	unsigned int i = 0;
+
+	assert(NULL != priorities);
+
+	for ( ; priorities->count > i; ++i) {
+		free(priorities->patterns[i]);
+	}
+	free(priorities->patterns);
+}
+
+static bool _append_device(const char *path, devices_t *devices) {
 	/* the alias attributes */
 	struct stat attributes = {0};
 
+	/* the enlarged devices array */
+	device_t *new_devices = NULL;
+
 	/* the return value */
 	bool result = false;
 
@@ -37,6 +340,7 @@ static bool _handle_existing_device(const char *path, void *unused) {
 	char *alias = NULL;
 
 	assert(NULL != path);
+	assert(NULL != devices);
 
 	/* get the alias size */
 	if (-1 == stat(path, &attributes)) {
@@ -62,19 +366,22 @@ static bool _handle_existing_device(const char *path, void *unused) {
 	}
 	alias[length - 1] = '\0';
 
-	/* run modprobe */
-	switch (daemon_fork()) {
-		case 0:
-			(void) execlp("modprobe", "modprobe", alias, (char *) NULL);
-			exit(EXIT_FAILURE);
+	/* enlarge the devices array */
+	new_devices = realloc(devices->devices,
+	                      sizeof(device_t) * (1 + devices->count));
+	if (NULL == new_devices) {
+		goto close_file;
+	}
+	devices->devices = new_devices;
 
-		case (-1):
-			goto close_file;
+	/* append the device; the alias is freed with the array */
+	devices->devices[devices->count].alias = alias;
+	devices->devices[devices->count].priority = 0;
+	++devices->count;
+	alias = NULL;
 
-		default:
-			result = true;
-			break;
-	}
+	/* report success */
+	result = true;
 
 close_file:
 	/* close the file */
@@ -88,9 +395,412 @@ end:
 	return result;
 }
 
-static bool _handle_new_device(unsigned char *message, const size_t len) {
+static unsigned int _get_priority(const priorities_t *priorities,
+                                  const char *alias) {
+	/* a loop index */
+	unsigned int i = 0;
+
+	assert(NULL != priorities);
+	assert(NULL != alias);
+
+	/* find the first matching pattern; devices which match no pattern come
+	 * last */
+	for ( ; priorities->count > i; ++i) {
+		if (0 == fnmatch(priorities->patterns[i], alias, 0)) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+static bool _handle_existing_devices(devd_t *devd) {
+	/* existing devices */
+	devices_t devices = {0};
+
+	/* loop indices */
+	unsigned int i = 0;
+	unsigned int j = 0;
+
+	/* send flags */
+	int flags = 0;
+
 	/* the return value */
-	bool result = true;
+	bool result = false;
+
+	assert(NULL != devd);
+
+	/* list existing devices - each device has a file named "modalias" which
+	 * specifies the matching module alias */
+	if (false == find_all("/sys/devices",
+	                      "modalias",
+	                      (file_callback_t) _append_device,
+	                      &devices)) {
+		goto free_devices;
+	}
+
+	/* prioritize the devices */
+	for ( ; devices.count > i; ++i) {
+		devices.devices[i].priority = _get_priority(
+		                                     &devd->priorities,
+		                                     devices.devices[i].alias);
+	}
+
+	/* load kernel modules for existing devices, by priority; within the same
+	 * priority, keep the directory order. If modprobed is not running yet or
+	 * a request cannot be sent, run modprobe instead; once modprobed is too
+	 * slow to accept one, stop waiting for it, so a stuck modprobed does not
+	 * hold coldplug for the send timeout of each device */
+	for (i = 0; devd->priorities.count >= i; ++i) {
+		for (j = 0; devices.count > j; ++j) {
+			if (i != devices.devices[j].priority) {
+				continue;
+			}
+			if (false == _request_module(devd,
+			                             devices.devices[j].alias,
+			                             flags)) {
+				if (EAGAIN == errno) {
+					flags = MSG_DONTWAIT;
+				}
+				(void) _run_modprobe(devd, devices.devices[j].alias);
+			}
+		}
+	}
+
+	/* report success */
+	result = true;
+
+free_devices:
+	/* free the devices array */
+	for (i = 0; devices.count > i; ++i) {
+		free(devices.devices[i].alias);
+	}
+	free(devices.devices);
+
+	return result;
+}
+
+static bus_t *_get_bus(statistics_t *statistics, const char *name) {
+	/* a loop index */
+	unsigned int i = 0;
+
+	assert(NULL != statistics);
+	assert(NULL != name);
+
+	/* look for the bus */
+	for ( ; statistics->bus_count > i; ++i) {
+		if (0 == strncmp(statistics->buses[i].name, name, MAX_BUS_LENGTH)) {
+			return &statistics->buses[i];
+		}
+	}
+
+	/* if there is no room for another bus, do not measure latency */
+	if (MAX_BUSES == statistics->bus_count) {
+		return NULL;
+	}
+
+	/* add the bus */
+	(void) strncpy(statistics->buses[i].name, name, MAX_BUS_LENGTH);
+	++statistics->bus_count;
+	return &statistics->buses[i];
+}
+
+static void _track_request(statistics_t *statistics,
+                           const struct timespec *received,
+                           const uint64_t seqnum,
+                           const char *bus,
+                           const char *name) {
+	/* the request */
+	request_t *request = NULL;
+
+	/* a loop index */
+	unsigned int i = 0;
+
+	assert(NULL != statistics);
+	assert(NULL != received);
+	assert(NULL != bus);
+	assert(NULL != name);
+
+	/* if the module name or alias is too long, do not measure latency */
+	if (sizeof(request->name) <= strlen(name)) {
+		return;
+	}
+
+	/* use a free slot or, if there is none, give up on the oldest request */
+	request = &statistics->pending[0];
+	for ( ; MAX_PENDING > i; ++i) {
+		if (NULL == statistics->pending[i].bus) {
+			request = &statistics->pending[i];
+			break;
+		}
+		if (request->seqnum > statistics->pending[i].seqnum) {
+			request = &statistics->pending[i];
+		}
+	}
+	if (NULL != request->bus) {
+		++statistics->unanswered;
+	}
+
+	request->bus = _get_bus(statistics, bus);
+	request->seqnum = seqnum;
+	request->received = *received;
+	(void) strcpy(request->name, name);
+}
+
+static void _complete_request(statistics_t *statistics,
+                              const struct timespec *completed,
+                              const char *report) {
+	/* the request */
+	request_t *request = NULL;
+
+	/* the driver loading latency, in milliseconds */
+	long latency = 0;
+
+	/* loop indices */
+	unsigned int i = 0;
+	unsigned int j = 0;
+
+	assert(NULL != statistics);
+	assert(NULL != completed);
+	assert(NULL != report);
+
+	/* find the earliest request for the module */
+	for ( ; MAX_PENDING > i; ++i) {
+		if (NULL == statistics->pending[i].bus) {
+			continue;
+		}
+		if (0 != strcmp(&report[1], statistics->pending[i].name)) {
+			continue;
+		}
+		if ((NULL == request) ||
+		    (request->seqnum > statistics->pending[i].seqnum)) {
+			request = &statistics->pending[i];
+		}
+	}
+	if (NULL == request) {
+		return;
+	}
+
+	/* add the request latency to the bus histogram */
+	if (MODPROBED_SUCCESS == report[0]) {
+		latency = (completed->tv_sec - request->received.tv_sec) * 1000 +
+		          (completed->tv_nsec - request->received.tv_nsec) / 1000000;
+		for (j = 0; (LATENCY_BUCKETS - 1) > j; ++j) {
+			if ((1L << j) > latency) {
+				break;
+			}
+		}
+		++request->bus->histogram[j];
+	} else {
+		++request->bus->failures;
+	}
+
+	request->bus = NULL;
+	statistics->is_changed = true;
+}
+
+static void _expire_requests(statistics_t *statistics,
+                             const struct timespec *now) {
+	/* a loop index */
+	unsigned int i = 0;
+
+	assert(NULL != statistics);
+	assert(NULL != now);
+
+	for ( ; MAX_PENDING > i; ++i) {
+		if (NULL == statistics->pending[i].bus) {
+			continue;
+		}
+		if (REQUEST_TIMEOUT > (now->tv_sec -
+		                       statistics->pending[i].received.tv_sec)) {
+			continue;
+		}
+		statistics->pending[i].bus = NULL;
+		++statistics->unanswered;
+		statistics->is_changed = true;
+	}
+}
+
+static void _log_statistics(statistics_t *statistics) {
+	/* a line in the summary */
+	char line[1 + MAX_LENGTH] = {'\0'};
+
+	/* the line length */
+	int length = 0;
+
+	/* loop indices */
+	unsigned int i = 0;
+	unsigned int j = 0;
+
+	assert(NULL != statistics);
+
+	/* if nothing happened since the last summary, stay silent */
+	if (false == statistics->is_changed) {
+		return;
+	}
+	statistics->is_changed = false;
+
+	syslog(LOG_INFO,
+	       "%u events received, %u missed, %u overflows, %u duplicate, "
+	       "%u unanswered, %u coalesced, %u throttled, %u unsent",
+	       statistics->received,
+	       statistics->dropped,
+	       statistics->overflows,
+	       statistics->duplicates,
+	       statistics->unanswered,
+	       statistics->coalesced,
+	       statistics->throttled,
+	       statistics->unsent);
+
+	/* log the latency histogram of each bus, skipping empty buckets */
+	for ( ; statistics->bus_count > i; ++i) {
+		length = snprintf(line,
+		                  sizeof(line),
+		                  "%s: %u failures, latency (ms):",
+		                  statistics->buses[i].name,
+		                  statistics->buses[i].failures);
+		for (j = 0; LATENCY_BUCKETS > j; ++j) {
+			if ((0 == statistics->buses[i].histogram[j]) ||
+			    (sizeof(line) <= length)) {
+				continue;
+			}
+			length += snprintf(&line[length],
+			                   sizeof(line) - length,
+			                   " %s%ld:%u",
+			                   ((LATENCY_BUCKETS - 1) == j) ? ">=" : "<",
+			                   1L << (((LATENCY_BUCKETS - 1) == j) ? j - 1 : j),
+			                   statistics->buses[i].histogram[j]);
+		}
+		syslog(LOG_INFO, "%s", line);
+	}
+}
+
+static long _get_elapsed(const struct timespec *since,
+                         const struct timespec *now) {
+	assert(NULL != since);
+	assert(NULL != now);
+
+	/* return the elapsed time in milliseconds */
+	return ((now->tv_sec - since->tv_sec) * 1000) +
+	       ((now->tv_nsec - since->tv_nsec) / 1000000);
+}
+
+static void _refill(bucket_t *bucket,
+                    const struct timespec *now,
+                    const double rate,
+                    const double burst) {
+	assert(NULL != bucket);
+	assert(NULL != now);
+
+	/* refill the bucket, according to the time passed since the last event,
+	 * without rounding it, so frequent events do not lose time */
+	bucket->tokens += rate * ((double) (now->tv_sec - bucket->updated.tv_sec) +
+	                          ((double) (now->tv_nsec -
+	                                     bucket->updated.tv_nsec) / 1e9));
+	if (burst < bucket->tokens) {
+		bucket->tokens = burst;
+	}
+	bucket->updated = *now;
+}
+
+static bool _is_same_device(const device_state_t *device,
+                            const uint32_t hash,
+                            const char *path) {
+	assert(NULL != device);
+	assert(NULL != path);
+
+	return ((true == device->is_used) &&
+	        (hash == device->hash) &&
+	        (0 == strncmp(device->path, path, MAX_DEVICE_PATH_LENGTH)));
+}
+
+static bool _is_storm(devd_t *devd,
+                      const struct timespec *received,
+                      const char *path) {
+	/* the device state */
+	device_state_t *device = NULL;
+
+	/* the device path hash */
+	uint32_t hash = 2166136261U;
+
+	/* a loop index */
+	unsigned int i = 0;
+
+	assert(NULL != devd);
+	assert(NULL != received);
+	assert(NULL != path);
+
+	/* hash the device path, using FNV-1a */
+	for ( ; '\0' != path[i]; ++i) {
+		hash = (hash ^ (unsigned char) path[i]) * 16777619U;
+	}
+
+	/* look for the device; if it is not there, replace the least recently
+	 * handled device */
+	device = &devd->storm.devices[0];
+	for (i = 0; MAX_DEVICES > i; ++i) {
+		if (true == _is_same_device(&devd->storm.devices[i], hash, path)) {
+			device = &devd->storm.devices[i];
+			break;
+		}
+		if (false == devd->storm.devices[i].is_used) {
+			device = &devd->storm.devices[i];
+			continue;
+		}
+		if ((true == device->is_used) &&
+		    (0 < _get_elapsed(&devd->storm.devices[i].handled,
+		                      &device->handled))) {
+			device = &devd->storm.devices[i];
+		}
+	}
+
+	/* devices seen for the first time are always handled */
+	if (false == _is_same_device(device, hash, path)) {
+		device->hash = hash;
+		(void) strncpy(device->path, path, MAX_DEVICE_PATH_LENGTH);
+		device->path[MAX_DEVICE_PATH_LENGTH] = '\0';
+		device->is_used = true;
+		device->is_throttled = false;
+		device->bucket.tokens = DEVICE_BURST - 1;
+		device->bucket.updated = *received;
+		device->handled = *received;
+		return false;
+	}
+
+	/* coalesce events which repeat within a short time */
+	if (COALESCE_WINDOW > _get_elapsed(&device->handled, received)) {
+		++devd->statistics.coalesced;
+		return true;
+	}
+
+	/* enforce the per-device and global rate limits on repeated events; a
+	 * token is taken from each bucket only if both have one, so events
+	 * rejected by one limit are not charged to the other */
+	_refill(&device->bucket, received, DEVICE_RATE, DEVICE_BURST);
+	_refill(&devd->storm.bucket, received, GLOBAL_RATE, GLOBAL_BURST);
+	if ((1 > device->bucket.tokens) || (1 > devd->storm.bucket.tokens)) {
+		if (false == device->is_throttled) {
+			syslog(LOG_WARNING, "Throttling events of %s", path);
+			device->is_throttled = true;
+		}
+		++devd->statistics.throttled;
+		return true;
+	}
+
+	--device->bucket.tokens;
+	--devd->storm.bucket.tokens;
+	device->is_throttled = false;
+	device->handled = *received;
+	return false;
+}
+
+static bool _handle_new_device(devd_t *devd,
+                               const struct timespec *received,
+                               unsigned char *message,
+                               const size_t len,
+                               uint64_t *seqnum) {
+	/* the return value */
+	bool result = false;
 
 	/* the current position inside the message */
 	char *position = NULL;
@@ -107,14 +817,25 @@ static bool _handle_new_device(unsigned char *message, const size_t len) {
 	/* the kernel module name */
 	char *name = NULL;
 
+	/* the device bus */
+	char *bus = NULL;
+
+	/* the device path */
+	const char *path = NULL;
+
+	assert(NULL != devd);
+	assert(NULL != received);
 	assert(NULL != message);
 	assert(0 < len);
+	assert(NULL != seqnum);
 
-	/* locate the @ sign at the message beginning */
+	/* locate the @ sign at the message beginning, followed by the device
+	 * path */
 	position = strchr((char *) message, '@');
 	if (NULL == position) {
 		goto end;
 	}
+	path = 1 + position;
 
 	do {
 		/* locate the delimeter between the field name and its value */
@@ -123,25 +844,34 @@ static bool _handle_new_device(unsigned char *message, const size_t len) {
 			position += (1 + strlen(position));
 			continue;
 		}
+		++delimeter;
 
-		/* filter the action and module alias fields */
+		/* filter the action, module alias, driver, bus and sequence number
+		 * fields */
 		if (0 == strncmp("MODALIAS=", position, STRLEN("MODALIAS="))) {
-			alias = ++delimeter;
-		} else {
-			if (0 == strncmp("ACTION=", position, STRLEN("ACTION="))) {
-				action = ++delimeter;
-			} else {
-				if (0 == strncmp("DRIVER=", position, STRLEN("DRIVER="))) {
-					name = ++delimeter;
-				}
-			}
+			alias = delimeter;
+		}
+		if (0 == strncmp("ACTION=", position, STRLEN("ACTION="))) {
+			action = delimeter;
+		}
+		if (0 == strncmp("DRIVER=", position, STRLEN("DRIVER="))) {
+			name = delimeter;
+		}
+		if (0 == strncmp("SUBSYSTEM=", position, STRLEN("SUBSYSTEM="))) {
+			bus = delimeter;
+		}
+		if (0 == strncmp("SEQNUM=", position, STRLEN("SEQNUM="))) {
+			*seqnum = strtoull(delimeter, NULL, 10);
 		}
 
 		/* locate the line end and skip past the null byte */
-		position += (1 + strlen(delimeter));
+		position = delimeter + (1 + strlen(delimeter));
 	} while (len >= ((unsigned char *) position - message));
 
-	/* if no module name or alias was specified, do nothing */
+	/* if no action, module name or alias was specified, do nothing */
+	if (NULL == action) {
+		goto end;
+	}
 	if (NULL == name) {
 		if (NULL == alias) {
 			goto end;
@@ -149,15 +879,21 @@ static bool _handle_new_device(unsigned char *message, const size_t len) {
 		name = alias;
 	}
 
-	/* if a device was added, run modprobe */
+	/* if a device was added, ask modprobed to load its driver and measure the
+	 * time it takes, unless the device is flapping */
 	if (0 == strcmp("add", action)) {
-		switch (daemon_fork()) {
-			case 0:
-				(void) execlp("modprobe", "modprobe", name, (char *) NULL);
-				exit(EXIT_FAILURE);
-
-			case (-1):
-				goto end;
+		if (true == _is_storm(devd, received, path)) {
+			result = true;
+			goto end;
+		}
+		/* never block the event loop; if modprobed cannot accept the
+		 * request, run modprobe instead, whose latency is not measured */
+		if (false == _request_module(devd, name, MSG_DONTWAIT)) {
+			result = _run_modprobe(devd, name);
+			goto end;
+		}
+		if ((NULL != bus) && (0 != *seqnum)) {
+			_track_request(&devd->statistics, received, *seqnum, bus, name);
 		}
 	}
 
@@ -168,25 +904,193 @@ end:
 	return result;
 }
 
-int main(int argc, char *argv[]) {
-	/* the receiving buffer */
-	unsigned char buffer[MAX_MESSAGE_SIZE] = {0};
+static bool _receive_reports(devd_t *devd) {
+	/* a report */
+	char report[2 + MAX_LENGTH] = {'\0'};
+
+	/* the report completion time */
+	struct timespec completed = {0};
+
+	/* the report size */
+	ssize_t size = 0;
 
-	/* the daemon data */
-	daemon_t daemon_data = {{{0}}};
+	assert(NULL != devd);
+
+	do {
+		size = recv(devd->requests,
+		            report,
+		            sizeof(report) - 1,
+		            MSG_DONTWAIT);
+		switch (size) {
+			case (-1):
+				if (EAGAIN != errno) {
+					return false;
+				}
+				return true;
+
+			case 0:
+			case 1:
+				continue;
+		}
+
+		/* terminate the report */
+		report[size] = '\0';
+
+		/* match the report with the request */
+		if (-1 == clock_gettime(CLOCK_MONOTONIC, &completed)) {
+			return false;
+		}
+		_complete_request(&devd->statistics, &completed, report);
+	} while (1);
+}
+
+static bool _receive_messages(devd_t *devd) {
+	/* the receiving buffers */
+	static unsigned char buffers[RING_SIZE][MAX_MESSAGE_SIZE] = {{0}};
+
+	/* the buffer descriptors */
+	struct iovec vectors[RING_SIZE] = {{0}};
+	struct mmsghdr messages[RING_SIZE] = {{{0}}};
+
+	/* the event sequence number */
+	uint64_t seqnum = 0;
+
+	/* a loop index */
+	int i = 0;
+
+	/* the number of received messages */
+	int count = 0;
+
+	/* the time messages were received at */
+	struct timespec received = {0};
+
+	/* a flag which indicates whether events were missed */
+	bool missed = false;
+
+	assert(NULL != devd);
+
+	for ( ; RING_SIZE > i; ++i) {
+		vectors[i].iov_base = buffers[i];
+		vectors[i].iov_len = sizeof(buffers[i]) - 1;
+		messages[i].msg_hdr.msg_iov = &vectors[i];
+		messages[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	do {
+		/* receive all queued messages */
+		count = recvmmsg(devd->daemon.fd,
+		                 messages,
+		                 RING_SIZE,
+		                 MSG_DONTWAIT,
+		                 NULL);
+		if (-1 == count) {
+			switch (errno) {
+				case EAGAIN:
+					goto rescan;
+
+				/* if the socket buffer overflowed, messages were dropped */
+				case ENOBUFS:
+					syslog(LOG_WARNING, "The event queue has overflowed");
+					++devd->statistics.overflows;
+					devd->statistics.is_changed = true;
+					missed = true;
+					continue;
+
+				default:
+					return false;
+			}
+		}
+
+		/* get the time the messages were received at */
+		if (-1 == clock_gettime(CLOCK_MONOTONIC, &received)) {
+			return false;
+		}
+
+		for (i = 0; count > i; ++i) {
+			if (0 == messages[i].msg_len) {
+				continue;
+			}
+
+			/* terminate the message */
+			buffers[i][messages[i].msg_len] = '\0';
+
+			/* handle the received message */
+			seqnum = 0;
+			(void) _handle_new_device(devd,
+			                          &received,
+			                          buffers[i],
+			                          (size_t) messages[i].msg_len,
+			                          &seqnum);
+			++devd->statistics.received;
+			devd->statistics.is_changed = true;
+
+			/* check whether events were skipped since the previous one;
+			 * ignore events which arrive out of order and gaps caused by
+			 * the socket filter */
+			if (0 == seqnum) {
+				continue;
+			}
+			if (devd->last_seqnum >= seqnum) {
+				++devd->statistics.duplicates;
+				continue;
+			}
+			if ((false == devd->is_filtered) &&
+			    (0 != devd->last_seqnum) &&
+			    ((1 + devd->last_seqnum) < seqnum)) {
+				syslog(LOG_WARNING,
+				       "Missed %"PRIu64" events",
+				       seqnum - devd->last_seqnum - 1);
+				devd->statistics.dropped += (seqnum - devd->last_seqnum - 1);
+				missed = true;
+			}
+			devd->last_seqnum = seqnum;
+		}
+	} while (1);
+
+rescan:
+	/* if events were missed, scan all devices again */
+	if (true == missed) {
+		syslog(LOG_INFO, "Handling existing devices again");
+		(void) _handle_existing_devices(devd);
+	}
+
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	/* the daemon state */
+	devd_t devd = {{{{0}}}};
 
 	/* the netlink socket address */
 	struct sockaddr_nl netlink_address = {0};
 
-	/* the received message size */
-	ssize_t message_size = 0;
-
 	/* the exit code */
 	int exit_code = EXIT_FAILURE;
 
 	/* a received signal */
 	int received_signal = 0;
 
+	/* the netlink socket receiving buffer size */
+	int buffer_size = RECEIVE_BUFFER_SIZE;
+
+	/* the socket filter */
+	struct sock_fprog filter = {ARRAY_SIZE(g_filter), g_filter};
+
+	/* the requests socket address */
+	struct sockaddr_un unix_address = {0};
+
+	/* the requests timeout */
+	struct timeval send_timeout = {SEND_TIMEOUT, 0};
+
+	/* the current time */
+	struct timespec now = {0};
+
+	/* the time of the next statistics summary */
+	struct timespec next_summary = {0};
+
+	/* the time left until the next statistics summary */
+	struct timespec timeout = {0};
+
 	/* make sure the number of command-line arguments is valid */
 	if (1 != argc) {
 		PRINT(USAGE);
@@ -194,47 +1098,122 @@ int main(int argc, char *argv[]) {
 	}
 
 	/* create a netlink socket */
-	daemon_data.fd = socket(AF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT);
-	if (-1 == daemon_data.fd) {
+	devd.daemon.fd = socket(AF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT);
+	if (-1 == devd.daemon.fd) {
 		goto end;
 	}
 
+	/* enlarge the socket receiving buffer, to survive bursts of events; if the
+	 * limit cannot be overridden, settle for the maximum */
+	if (-1 == setsockopt(devd.daemon.fd,
+	                     SOL_SOCKET,
+	                     SO_RCVBUFFORCE,
+	                     &buffer_size,
+	                     sizeof(buffer_size))) {
+		(void) setsockopt(devd.daemon.fd,
+		                  SOL_SOCKET,
+		                  SO_RCVBUF,
+		                  &buffer_size,
+		                  sizeof(buffer_size));
+	}
+
+	/* drop uninteresting events before they reach the socket buffer; if the
+	 * filter cannot be attached, all events are received */
+	if (0 == setsockopt(devd.daemon.fd,
+	                    SOL_SOCKET,
+	                    SO_ATTACH_FILTER,
+	                    &filter,
+	                    sizeof(filter))) {
+		devd.is_filtered = true;
+	}
+
 	/* bind the socket */
 	netlink_address.nl_family = AF_NETLINK;
 	netlink_address.nl_pid = getpid();
-	netlink_address.nl_groups = (-1);
-	if (-1 == bind(daemon_data.fd,
+	netlink_address.nl_groups = KERNEL_EVENTS;
+	if (-1 == bind(devd.daemon.fd,
 	               (struct sockaddr *) &netlink_address,
 	               sizeof(netlink_address))) {
 		goto close_netlink;
 	}
 
+	/* create a Unix socket for driver loading requests */
+	devd.requests = socket(AF_UNIX, SOCK_DGRAM, 0);
+	if (-1 == devd.requests) {
+		goto close_netlink;
+	}
+
+	/* do not block forever if modprobed is stuck */
+	if (-1 == setsockopt(devd.requests,
+	                     SOL_SOCKET,
+	                     SO_SNDTIMEO,
+	                     &send_timeout,
+	                     sizeof(send_timeout))) {
+		goto close_requests;
+	}
+
+	devd.modprobed_address.sun_family = AF_UNIX;
+	(void) strcpy(devd.modprobed_address.sun_path, MODPROBED_SOCKET_PATH);
+
 	/* open the system log*/
 	openlog("devd", LOG_NDELAY, LOG_DAEMON);
 
+	/* load the coldplug priorities */
+	if (false == _load_priorities(&devd.priorities)) {
+		goto free_priorities;
+	}
+
 	/* write a log message before existing devices are handled */
 	syslog(LOG_INFO, "Handling existing devices");
 
-	/* load kernel modules for existing devices - each device has a file named
-	 * "modalias" which specifies the matching module alias */
-	if (false == find_all("/sys/devices",
-	                      "modalias",
-	                      (file_callback_t) _handle_existing_device,
-	                      NULL)) {
-		goto close_log;
+	/* load kernel modules for existing devices */
+	if (false == _handle_existing_devices(&devd)) {
+		goto free_priorities;
+	}
+
+	/* bind the requests socket to an automatically-chosen address, so
+	 * modprobed reports back once a driver is loaded; this is done only now,
+	 * since nobody receives reports about existing devices */
+	unix_address.sun_family = AF_UNIX;
+	if (-1 == bind(devd.requests,
+	               (struct sockaddr *) &unix_address,
+	               sizeof(sa_family_t))) {
+		goto free_priorities;
 	}
 
 	/* initialize the daemon */
-	if (false == daemon_init(&daemon_data, DAEMON_WORKING_DIRECTORY, NULL)) {
-		goto close_log;
+	if (false == daemon_init(&devd.daemon, DAEMON_WORKING_DIRECTORY, NULL)) {
+		goto free_priorities;
+	}
+
+	/* receive reports from modprobed, too */
+	if (false == daemon_watch(&devd.daemon, devd.requests)) {
+		goto free_priorities;
 	}
 
 	/* write another log message when newly added devices are handled */
 	syslog(LOG_INFO, "Handling new devices");
 
+	if (-1 == clock_gettime(CLOCK_MONOTONIC, &next_summary)) {
+		goto free_priorities;
+	}
+	next_summary.tv_sec += SUMMARY_INTERVAL;
+
 	do {
-		/* wait for a message */
-		if (false == daemon_wait(&daemon_data, &received_signal)) {
+		/* wait for a message or the next statistics summary */
+		if (-1 == clock_gettime(CLOCK_MONOTONIC, &now)) {
+			break;
+		}
+		if (now.tv_sec >= next_summary.tv_sec) {
+			_expire_requests(&devd.statistics, &now);
+			_log_statistics(&devd.statistics);
+			next_summary.tv_sec = now.tv_sec + SUMMARY_INTERVAL;
+		}
+		timeout.tv_sec = next_summary.tv_sec - now.tv_sec;
+		if (false == daemon_timed_wait(&devd.daemon,
+		                               &received_signal,
+		                               &timeout,
+		                               NULL)) {
 			break;
 		}
 
@@ -244,35 +1223,29 @@ int main(int argc, char *argv[]) {
 			break;
 		}
 
-		/* receive a message */
-		message_size = recv(daemon_data.fd, buffer, (sizeof(buffer) - 1), 0);
-		switch (message_size) {
-			case (-1):
-				if (EAGAIN != errno) {
-					goto close_log;
-				}
-
-				/* fall through */
-
-			case 0:
-				continue;
+		/* receive and handle all queued messages and reports */
+		if (false == _receive_messages(&devd)) {
+			break;
+		}
+		if (false == _receive_reports(&devd)) {
+			break;
 		}
-
-		/* terminate the message */
-		buffer[message_size] = '\0';
-
-		/* handle the received message */
-		(void) _handle_new_device(buffer, (size_t) message_size);
-
 	} while (1);
 
-close_log:
+free_priorities:
+	/* free the coldplug priorities */
+	_free_priorities(&devd.priorities);
+
 	/* close the system log */
 	closelog();
 
+close_requests:
+	/* close the requests socket */
+	(void) close(devd.requests);
+
 close_netlink:
 	/* close the netlink socket */
-	(void) close(daemon_data.fd);
+	(void) close(devd.daemon.fd);
 
 end:
 	return exit_code;
@@ -0,0 +1,640 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <syslog.h>
+#include <assert.h>
+
+#include "forward.h"
+
+/* the forwarded message format: the priority, a timestamp and the host name
+ * precede the tag */
+#define FRAME_FORMAT "<%d>%s %s %.*s"
+
+/* the timestamp format of forwarded messages */
+#define TIMESTAMP_FORMAT "%b %e %H:%M:%S"
+
+/* the maximum length of a forwarded message */
+#define MAX_FRAME_LENGTH (64 + HOST_NAME_MAX + MAX_MESSAGE_LENGTH)
+
+/* the message forwarded after messages were dropped */
+#define DROPPED_MESSAGE \
+	"<%d>syslogd: %u messages were dropped, since the collector was " \
+	"unreachable"
+
+static bool _is_due(const struct timespec *deadline,
+                    const struct timespec *now) {
+	return ((now->tv_sec > deadline->tv_sec) ||
+	        ((now->tv_sec == deadline->tv_sec) &&
+	         (now->tv_nsec >= deadline->tv_nsec)));
+}
+
+static void _delay(struct timespec *deadline,
+                   const struct timespec *now,
+                   const long milliseconds) {
+	deadline->tv_sec = now->tv_sec + (milliseconds / 1000);
+	deadline->tv_nsec = now->tv_nsec + ((milliseconds % 1000) * 1000000L);
+	if (1000000000L <= deadline->tv_nsec) {
+		++deadline->tv_sec;
+		deadline->tv_nsec -= 1000000000L;
+	}
+}
+
+static size_t _get_frame_end(const forwarder_t *forwarder,
+                             const size_t offset,
+                             size_t *body) {
+	/* the message length */
+	size_t length = 0;
+
+	/* the offset of the message */
+	size_t i = offset;
+
+	/* frames are prefixed with their length, as in RFC 6587, so they can
+	 * be sent over a stream as they are */
+	for ( ; ' ' != forwarder->buffer[i]; ++i) {
+		length = (length * 10) + (size_t) (forwarder->buffer[i] - '0');
+	}
+	++i;
+
+	if (NULL != body) {
+		*body = i;
+	}
+	return i + length;
+}
+
+static void _consume(forwarder_t *forwarder, const size_t size) {
+	assert(NULL != forwarder);
+	assert(forwarder->length >= size);
+
+	forwarder->length -= size;
+	(void) memmove(forwarder->buffer,
+	               &forwarder->buffer[size],
+	               forwarder->length);
+}
+
+static void _drop(forwarder_t *forwarder, const size_t size) {
+	/* the offset of the first frame which may be dropped */
+	size_t start = 0;
+
+	/* the end of the dropped frames */
+	size_t end = 0;
+
+	assert(NULL != forwarder);
+
+	/* a partially sent frame cannot be dropped, since the rest of it must
+	 * follow */
+	if (0 < forwarder->sent) {
+		start = _get_frame_end(forwarder, 0, NULL);
+	}
+
+	/* drop the oldest frames, at least the given size of them */
+	for (end = start;
+	     ((end - start) < size) && (forwarder->length > end);
+	     end = _get_frame_end(forwarder, end, NULL)) {
+		++forwarder->dropped;
+	}
+
+	(void) memmove(&forwarder->buffer[start],
+	               &forwarder->buffer[end],
+	               forwarder->length - end);
+	forwarder->length -= end - start;
+}
+
+static bool _resolve(const forwarder_t *forwarder,
+                     struct sockaddr_storage *address,
+                     socklen_t *address_size) {
+	/* the address resolving hints */
+	struct addrinfo hints = {0};
+
+	/* the collector address */
+	struct addrinfo *addresses = NULL;
+
+	/* the return value */
+	bool result = false;
+
+	assert(NULL != forwarder);
+	assert(NULL != address);
+	assert(NULL != address_size);
+
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = forwarder->type;
+	if (0 != getaddrinfo(forwarder->host,
+	                     forwarder->port,
+	                     &hints,
+	                     &addresses)) {
+		return false;
+	}
+	if (sizeof(*address) >= addresses->ai_addrlen) {
+		(void) memcpy(address, addresses->ai_addr, addresses->ai_addrlen);
+		*address_size = addresses->ai_addrlen;
+		result = true;
+	}
+	freeaddrinfo(addresses);
+
+	return result;
+}
+
+static void *_resolve_forever(void *arg) {
+	/* the forwarder */
+	forwarder_t *forwarder = (forwarder_t *) arg;
+
+	/* the resolved address */
+	struct sockaddr_storage address = {0};
+
+	/* the resolved address size */
+	socklen_t address_size = 0;
+
+	assert(NULL != forwarder);
+
+	/* resolve the collector address whenever the writing thread asks for
+	 * it, so name resolution never blocks writing to the log */
+	(void) pthread_mutex_lock(&forwarder->mutex);
+	do {
+		while ((false == forwarder->is_closing) &&
+		       (false == forwarder->is_resolution_requested)) {
+			(void) pthread_cond_wait(&forwarder->cond, &forwarder->mutex);
+		}
+		if (true == forwarder->is_closing) {
+			break;
+		}
+		forwarder->is_resolution_requested = false;
+		(void) pthread_mutex_unlock(&forwarder->mutex);
+
+		if (true == _resolve(forwarder, &address, &address_size)) {
+			(void) pthread_mutex_lock(&forwarder->mutex);
+			(void) memcpy(&forwarder->address, &address, address_size);
+			forwarder->address_size = address_size;
+			forwarder->is_resolved = true;
+		} else {
+			(void) pthread_mutex_lock(&forwarder->mutex);
+		}
+	} while (1);
+	(void) pthread_mutex_unlock(&forwarder->mutex);
+
+	return NULL;
+}
+
+static void _request_resolution(forwarder_t *forwarder) {
+	assert(NULL != forwarder);
+
+	(void) pthread_mutex_lock(&forwarder->mutex);
+	forwarder->is_resolution_requested = true;
+	(void) pthread_cond_signal(&forwarder->cond);
+	(void) pthread_mutex_unlock(&forwarder->mutex);
+}
+
+static bool _connect(forwarder_t *forwarder) {
+	/* the collector address */
+	struct sockaddr_storage address = {0};
+
+	/* the collector address size */
+	socklen_t address_size = 0;
+
+	assert(NULL != forwarder);
+	assert(-1 == forwarder->fd);
+
+	/* use the last resolved address, without waiting for name resolution;
+	 * if the collector was never resolved, or cannot be reached, resolve it
+	 * again in the background, so a collector which could not be resolved
+	 * yet, or moved, is reached by a later attempt */
+	(void) pthread_mutex_lock(&forwarder->mutex);
+	if (true == forwarder->is_resolved) {
+		(void) memcpy(&address, &forwarder->address, forwarder->address_size);
+		address_size = forwarder->address_size;
+	}
+	(void) pthread_mutex_unlock(&forwarder->mutex);
+	if (0 == address_size) {
+		_request_resolution(forwarder);
+		return false;
+	}
+
+	/* connect without blocking; until a stream is established, sending
+	 * fails with EAGAIN */
+	forwarder->fd = socket(address.ss_family,
+	                       forwarder->type | SOCK_NONBLOCK | SOCK_CLOEXEC,
+	                       0);
+	if (-1 == forwarder->fd) {
+		return false;
+	}
+	if ((-1 == connect(forwarder->fd,
+	                   (const struct sockaddr *) &address,
+	                   address_size)) &&
+	    (EINPROGRESS != errno)) {
+		(void) close(forwarder->fd);
+		forwarder->fd = -1;
+		_request_resolution(forwarder);
+		return false;
+	}
+
+	return true;
+}
+
+static void _disconnect(forwarder_t *forwarder, const struct timespec *now) {
+	assert(NULL != forwarder);
+	assert(NULL != now);
+
+	/* a partially sent frame is sent again, in full, over the next
+	 * connection; the collector may have moved, so resolve it again */
+	(void) close(forwarder->fd);
+	forwarder->fd = -1;
+	forwarder->sent = 0;
+	_delay(&forwarder->retry, now, FORWARD_RETRY_INTERVAL * 1000L);
+	_request_resolution(forwarder);
+}
+
+static bool _send_datagrams(forwarder_t *forwarder) {
+	/* the message descriptors */
+	struct iovec vectors[FORWARD_BATCH_SIZE] = {{0}};
+	struct mmsghdr messages[FORWARD_BATCH_SIZE] = {{{0}}};
+
+	/* the end of each message */
+	size_t ends[FORWARD_BATCH_SIZE] = {0};
+
+	/* the offset of a message */
+	size_t body = 0;
+
+	/* the number of messages */
+	int count = 0;
+
+	/* the number of messages sent */
+	int sent = 0;
+
+	assert(NULL != forwarder);
+
+	while (0 < forwarder->length) {
+		/* send each message in its own datagram, without the length
+		 * prefix, many at once */
+		for (count = 0;
+		     (FORWARD_BATCH_SIZE > count) &&
+		     ((0 == count) || (forwarder->length > ends[count - 1]));
+		     ++count) {
+			ends[count] = _get_frame_end(forwarder,
+			                             (0 == count) ? 0 : ends[count - 1],
+			                             &body);
+			vectors[count].iov_base = &forwarder->buffer[body];
+			vectors[count].iov_len = ends[count] - body;
+			messages[count].msg_hdr.msg_iov = &vectors[count];
+			messages[count].msg_hdr.msg_iovlen = 1;
+		}
+
+		sent = sendmmsg(forwarder->fd,
+		                messages,
+		                (unsigned int) count,
+		                MSG_DONTWAIT);
+		if (-1 == sent) {
+			return ((EAGAIN == errno) || (EWOULDBLOCK == errno));
+		}
+		_consume(forwarder, ends[sent - 1]);
+	}
+
+	return true;
+}
+
+static bool _send_stream(forwarder_t *forwarder) {
+	/* the number of bytes sent */
+	ssize_t size = 0;
+
+	/* the end of the fully sent frames */
+	size_t end = 0;
+
+	assert(NULL != forwarder);
+
+	while (forwarder->length > forwarder->sent) {
+		/* send all frames at once, as they are */
+		size = send(forwarder->fd,
+		            &forwarder->buffer[forwarder->sent],
+		            forwarder->length - forwarder->sent,
+		            MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (-1 == size) {
+			return ((EAGAIN == errno) || (EWOULDBLOCK == errno));
+		}
+		forwarder->sent += (size_t) size;
+
+		/* remove fully sent frames from the buffer */
+		end = 0;
+		while ((forwarder->sent > end) &&
+		       (forwarder->sent >= _get_frame_end(forwarder, end, NULL))) {
+			end = _get_frame_end(forwarder, end, NULL);
+		}
+		_consume(forwarder, end);
+		forwarder->sent -= end;
+	}
+
+	return true;
+}
+
+bool forwarder_open(forwarder_t *forwarder,
+                    char *collector,
+                    const bool is_stream) {
+	/* the collector port */
+	char *port = NULL;
+
+	/* the end of an IPv6 address */
+	char *end = NULL;
+
+	assert(NULL != forwarder);
+	assert(NULL != collector);
+
+	/* split the collector into an address, which may be an IPv6 one in
+	 * brackets, and a port */
+	port = strrchr(collector, ':');
+	if (NULL == port) {
+		return false;
+	}
+	*port = '\0';
+	++port;
+	if ('[' == collector[0]) {
+		end = strchr(collector, ']');
+		if ((NULL == end) || ('\0' != end[1])) {
+			return false;
+		}
+		*end = '\0';
+		++collector;
+	}
+
+	forwarder->host = collector;
+	forwarder->port = port;
+	forwarder->type = (true == is_stream) ? SOCK_STREAM : SOCK_DGRAM;
+
+	if (-1 == gethostname(forwarder->hostname, sizeof(forwarder->hostname))) {
+		return false;
+	}
+	forwarder->hostname[sizeof(forwarder->hostname) - 1] = '\0';
+
+	forwarder->length = 0;
+	forwarder->sent = 0;
+	forwarder->dropped = 0;
+	forwarder->retry.tv_sec = 0;
+	forwarder->retry.tv_nsec = 0;
+	forwarder->fd = -1;
+	forwarder->is_resolution_requested = false;
+	forwarder->is_closing = false;
+	forwarder->is_started = false;
+
+	/* resolve the collector address once, before messages are written; if
+	 * this fails, it is resolved again later, by another thread */
+	forwarder->is_resolved = _resolve(forwarder,
+	                                  &forwarder->address,
+	                                  &forwarder->address_size);
+
+	if (0 != pthread_mutex_init(&forwarder->mutex, NULL)) {
+		return false;
+	}
+	if (0 != pthread_cond_init(&forwarder->cond, NULL)) {
+		(void) pthread_mutex_destroy(&forwarder->mutex);
+		return false;
+	}
+
+	/* if the collector cannot be resolved or is unreachable, try again
+	 * later */
+	(void) _connect(forwarder);
+
+	return true;
+}
+
+bool forwarder_start(forwarder_t *forwarder) {
+	assert(NULL != forwarder);
+	assert(false == forwarder->is_started);
+
+	if (0 != pthread_create(&forwarder->resolver,
+	                        NULL,
+	                        _resolve_forever,
+	                        forwarder)) {
+		return false;
+	}
+	forwarder->is_started = true;
+
+	return true;
+}
+
+void forwarder_close(forwarder_t *forwarder) {
+	assert(NULL != forwarder);
+
+	/* forward whatever can be sent without blocking */
+	(void) forwarder_flush(forwarder);
+
+	if (-1 != forwarder->fd) {
+		(void) close(forwarder->fd);
+		forwarder->fd = -1;
+	}
+
+	/* stop the resolving thread */
+	if (true == forwarder->is_started) {
+		(void) pthread_mutex_lock(&forwarder->mutex);
+		forwarder->is_closing = true;
+		(void) pthread_cond_signal(&forwarder->cond);
+		(void) pthread_mutex_unlock(&forwarder->mutex);
+		(void) pthread_join(forwarder->resolver, NULL);
+	}
+
+	(void) pthread_cond_destroy(&forwarder->cond);
+	(void) pthread_mutex_destroy(&forwarder->mutex);
+}
+
+bool forwarder_forward(forwarder_t *forwarder, const message_t *message) {
+	/* the forwarded message */
+	char frame[1 + MAX_FRAME_LENGTH] = {'\0'};
+
+	/* the length prefix */
+	char prefix[32] = {'\0'};
+
+	/* the message timestamp */
+	char timestamp[32] = {'\0'};
+
+	/* the time the message was received, broken down */
+	struct tm received = {0};
+
+	/* the current time */
+	struct timespec now = {0};
+
+	/* the free space in the buffer */
+	size_t free_space = 0;
+
+	/* the message text length, without a trailing line break */
+	size_t length = 0;
+
+	/* the forwarded message length */
+	int frame_length = 0;
+
+	/* the length prefix length */
+	int prefix_length = 0;
+
+	assert(NULL != forwarder);
+	assert(NULL != message);
+
+	/* relays add a timestamp and the host name, as in RFC 3164; the
+	 * timestamp sent with the message, if any, is replaced */
+	if ((NULL == localtime_r(&message->realtime.tv_sec, &received)) ||
+	    (0 == strftime(timestamp,
+	                   sizeof(timestamp),
+	                   TIMESTAMP_FORMAT,
+	                   &received))) {
+		timestamp[0] = '\0';
+	}
+	length = message->length - message->tag_offset;
+	if ((0 < length) && ('\n' == message->text[message->length - 1])) {
+		--length;
+	}
+	frame_length = snprintf(frame,
+	                        sizeof(frame),
+	                        FRAME_FORMAT,
+	                        (message->facility << 3) | message->priority,
+	                        timestamp,
+	                        forwarder->hostname,
+	                        (int) length,
+	                        &message->text[message->tag_offset]);
+	if (sizeof(frame) <= (size_t) frame_length) {
+		frame_length = sizeof(frame) - 1;
+	}
+	prefix_length = snprintf(prefix, sizeof(prefix), "%d ", frame_length);
+
+	/* if there is no room for the message, drop a quarter of the buffer at
+	 * once, from the oldest messages */
+	free_space = sizeof(forwarder->buffer) - forwarder->length;
+	if ((size_t) (prefix_length + frame_length) > free_space) {
+		_drop(forwarder, sizeof(forwarder->buffer) / 4);
+	}
+	(void) memcpy(&forwarder->buffer[forwarder->length],
+	              prefix,
+	              (size_t) prefix_length);
+	forwarder->length += (size_t) prefix_length;
+	(void) memcpy(&forwarder->buffer[forwarder->length],
+	              frame,
+	              (size_t) frame_length);
+	forwarder->length += (size_t) frame_length;
+
+	/* if the buffer was empty, the message must be forwarded soon */
+	if (-1 == clock_gettime(CLOCK_MONOTONIC, &now)) {
+		return false;
+	}
+	if (forwarder->length == (size_t) (prefix_length + frame_length)) {
+		_delay(&forwarder->deadline, &now, FORWARD_DELAY);
+	}
+
+	/* forward messages in large batches, or once the deadline has passed */
+	if ((FORWARD_FLUSH_SIZE <= forwarder->length) ||
+	    (true == _is_due(&forwarder->deadline, &now))) {
+		return forwarder_flush(forwarder);
+	}
+
+	return true;
+}
+
+bool forwarder_flush(forwarder_t *forwarder) {
+	/* a report of dropped messages */
+	message_t report = {{0}};
+
+	/* the current time */
+	struct timespec now = {0};
+
+	/* the report text */
+	char text[128] = {'\0'};
+
+	/* the number of dropped messages */
+	unsigned int dropped = 0;
+
+	/* the return value */
+	bool is_sent = false;
+
+	assert(NULL != forwarder);
+
+	if (0 == forwarder->length) {
+		return true;
+	}
+
+	if (-1 == clock_gettime(CLOCK_MONOTONIC, &now)) {
+		return false;
+	}
+
+	/* if the collector is unreachable, try to reach it once in a while, and
+	 * keep the messages until then */
+	if (-1 == forwarder->fd) {
+		if (false == _is_due(&forwarder->retry, &now)) {
+			return true;
+		}
+		if (false == _connect(forwarder)) {
+			_delay(&forwarder->retry, &now, FORWARD_RETRY_INTERVAL * 1000L);
+			return true;
+		}
+	}
+
+	if (SOCK_STREAM == forwarder->type) {
+		is_sent = _send_stream(forwarder);
+	} else {
+		is_sent = _send_datagrams(forwarder);
+	}
+	if (false == is_sent) {
+		_disconnect(forwarder, &now);
+		return true;
+	}
+
+	/* if the socket buffer is full, try again later */
+	if (0 < forwarder->length) {
+		_delay(&forwarder->deadline, &now, FORWARD_DELAY);
+		return true;
+	}
+
+	/* once all messages are forwarded, report the dropped ones */
+	if (0 < forwarder->dropped) {
+		dropped = forwarder->dropped;
+		forwarder->dropped = 0;
+		message_init(&report,
+		             text,
+		             (size_t) snprintf(text,
+		                               sizeof(text),
+		                               DROPPED_MESSAGE,
+		                               LOG_SYSLOG | LOG_WARNING,
+		                               dropped));
+		return forwarder_forward(forwarder, &report);
+	}
+
+	return true;
+}
+
+bool forwarder_get_timeout(const forwarder_t *forwarder,
+                           struct timespec *timeout) {
+	/* the current time */
+	struct timespec now = {0};
+
+	/* the deadline */
+	const struct timespec *deadline = NULL;
+
+	assert(NULL != forwarder);
+	assert(NULL != timeout);
+
+	/* if the buffer is empty, there is no deadline */
+	if (0 == forwarder->length) {
+		return false;
+	}
+
+	/* if the collector is unreachable, wait until it should be reached
+	 * again */
+	deadline = &forwarder->deadline;
+	if (-1 == forwarder->fd) {
+		deadline = &forwarder->retry;
+	}
+
+	/* get the current time */
+	if (-1 == clock_gettime(CLOCK_MONOTONIC, &now)) {
+		timeout->tv_sec = 0;
+		timeout->tv_nsec = 0;
+		return true;
+	}
+
+	/* calculate the time left until the deadline */
+	timeout->tv_sec = deadline->tv_sec - now.tv_sec;
+	timeout->tv_nsec = deadline->tv_nsec - now.tv_nsec;
+	if (0 > timeout->tv_nsec) {
+		--timeout->tv_sec;
+		timeout->tv_nsec += 1000000000L;
+	}
+	if (0 > timeout->tv_sec) {
+		timeout->tv_sec = 0;
+		timeout->tv_nsec = 0;
+	}
+
+	return true;
+}
@@ -0,0 +1,63 @@
+#ifndef _FORWARD_H_INCLUDED
+#	define _FORWARD_H_INCLUDED
+
+#	include <stdbool.h>
+#	include <sys/types.h>
+#	include <sys/socket.h>
+#	include <limits.h>
+#	include <time.h>
+#	include <pthread.h>
+
+#	include "message.h"
+
+/* the size of the buffer messages are kept in until they are forwarded */
+#	define FORWARD_BUFFER_SIZE (256 * 1024)
+
+/* the size of buffered messages which are forwarded without waiting */
+#	define FORWARD_FLUSH_SIZE (64 * 1024)
+
+/* the maximum time, in milliseconds, a message may wait in the buffer */
+#	define FORWARD_DELAY (100)
+
+/* the interval, in seconds, between attempts to reach the collector */
+#	define FORWARD_RETRY_INTERVAL (5)
+
+/* the maximum number of datagrams sent at once */
+#	define FORWARD_BATCH_SIZE (64)
+
+typedef struct {
+	struct timespec deadline;
+	struct timespec retry;
+	pthread_t resolver;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct sockaddr_storage address;
+	socklen_t address_size;
+	const char *host;
+	const char *port;
+	size_t length;
+	size_t sent;
+	unsigned int dropped;
+	int fd;
+	int type;
+	bool is_resolved;
+	bool is_resolution_requested;
+	bool is_closing;
+	bool is_started;
+	char hostname[1 + HOST_NAME_MAX];
+	char buffer[FORWARD_BUFFER_SIZE];
+} forwarder_t;
+
+bool forwarder_open(forwarder_t *forwarder,
+                    char *collector,
+                    const bool is_stream);
+bool forwarder_start(forwarder_t *forwarder);
+void forwarder_close(forwarder_t *forwarder);
+
+bool forwarder_forward(forwarder_t *forwarder, const message_t *message);
+bool forwarder_flush(forwarder_t *forwarder);
+
+bool forwarder_get_timeout(const forwarder_t *forwarder,
+                           struct timespec *timeout);
+
+#endif
@@ -1,28 +1,229 @@
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
 #include <syslog.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/klog.h>
+#include <assert.h>
 
 #include "common.h"
 #include "daemon.h"
+#include "kmsg.h"
+#include "storm.h"
 
-/* the maximum length of a kernel log message */
+/* the path of the sequence number of the last kernel log record passed to the
+ * system log */
+#define STATE_PATH DAEMON_WORKING_DIRECTORY"/klogd.seq"
+
+/* the maximum number of messages sent at once */
+#define QUEUE_SIZE (64)
+
+/* the maximum length of a message */
 #define MAX_MESSAGE_LENGTH (MAX_LENGTH)
 
+/* the message format: the timestamp and tag are followed by the monotonic
+ * timestamp of the record, in seconds, and its text */
+#define MESSAGE_FORMAT "<%d>%s kernel: [%5" PRIu64 ".%06" PRIu64 "] %s"
+
+/* the timestamp format */
+#define TIMESTAMP_FORMAT "%b %e %H:%M:%S"
+
+/* the message sent after records were overwritten before they were read */
+#define LOST_MESSAGE "<%d>%s kernel: %" PRIu64 " kernel log records were lost"
+
+/* the interval, in milliseconds, between attempts to reach the system log */
+#define RETRY_INTERVAL (1000)
+
 /* the usage message */
 #define USAGE "Usage: klogd\n"
 
+/* messages waiting to be sent to the system log */
+typedef struct {
+	uint64_t sequences[QUEUE_SIZE];
+	size_t lengths[QUEUE_SIZE];
+	unsigned int count;
+	int fd;
+	char messages[QUEUE_SIZE][1 + MAX_MESSAGE_LENGTH];
+} queue_t;
+
+static void _get_timestamp(char *timestamp, const size_t size) {
+	/* the current time */
+	time_t now = 0;
+
+	/* the current time, broken down */
+	struct tm broken_down = {0};
+
+	now = time(NULL);
+	if ((NULL == localtime_r(&now, &broken_down)) ||
+	    (0 == strftime(timestamp, size, TIMESTAMP_FORMAT, &broken_down))) {
+		timestamp[0] = '\0';
+	}
+}
+
+static void _push(queue_t *queue, const uint64_t sequence, const int length) {
+	assert(NULL != queue);
+	assert(QUEUE_SIZE > queue->count);
+
+	/* the message was formatted in place; if it is too long, truncate it */
+	queue->lengths[queue->count] = (size_t) length;
+	if (sizeof(queue->messages[0]) <= (size_t) length) {
+		queue->lengths[queue->count] = sizeof(queue->messages[0]) - 1;
+	}
+	queue->sequences[queue->count] = sequence;
+	++queue->count;
+}
+
+static void _push_record(queue_t *queue,
+                         const kmsg_record_t *record,
+                         const char *timestamp) {
+	assert(NULL != queue);
+	assert(NULL != record);
+	assert(NULL != timestamp);
+
+	_push(queue,
+	      record->sequence,
+	      snprintf(queue->messages[queue->count],
+	               sizeof(queue->messages[0]),
+	               MESSAGE_FORMAT,
+	               (record->facility << 3) | record->priority,
+	               timestamp,
+	               record->timestamp / 1000000,
+	               record->timestamp % 1000000,
+	               record->text));
+}
+
+static uint64_t _get_now(void) {
+	/* the current time */
+	struct timespec now = {0};
+
+	/* similar messages are counted in windows of monotonic time */
+	if (-1 == clock_gettime(CLOCK_MONOTONIC, &now)) {
+		return 0;
+	}
+
+	return ((uint64_t) now.tv_sec * 1000) + ((uint64_t) now.tv_nsec / 1000000);
+}
+
+static bool _connect(queue_t *queue) {
+	/* the system log socket address */
+	struct sockaddr_un address = {0};
+
+	assert(NULL != queue);
+
+	queue->fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (-1 == queue->fd) {
+		return false;
+	}
+
+	/* if the system log is not running yet, try again later */
+	address.sun_family = AF_UNIX;
+	(void) strcpy(address.sun_path, _PATH_LOG);
+	if (-1 == connect(queue->fd,
+	                  (const struct sockaddr *) &address,
+	                  sizeof(address))) {
+		(void) close(queue->fd);
+		queue->fd = -1;
+		return false;
+	}
+
+	return true;
+}
+
+static bool _send(queue_t *queue, const kmsg_t *kmsg) {
+	/* the message descriptors */
+	struct iovec vectors[QUEUE_SIZE] = {{0}};
+	struct mmsghdr messages[QUEUE_SIZE] = {{{0}}};
+
+	/* a loop index */
+	unsigned int i = 0;
+
+	/* the number of messages sent */
+	int sent = 0;
+
+	assert(NULL != queue);
+	assert(NULL != kmsg);
+
+	if ((-1 == queue->fd) && (false == _connect(queue))) {
+		return true;
+	}
+
+	/* send all queued messages at once */
+	for ( ; queue->count > i; ++i) {
+		vectors[i].iov_base = queue->messages[i];
+		vectors[i].iov_len = queue->lengths[i];
+		messages[i].msg_hdr.msg_iov = &vectors[i];
+		messages[i].msg_hdr.msg_iovlen = 1;
+	}
+	sent = sendmmsg(queue->fd, messages, queue->count, 0);
+
+	/* if the system log stopped, keep the messages which were not sent and
+	 * reconnect later */
+	if (-1 == sent) {
+		(void) close(queue->fd);
+		queue->fd = -1;
+		return true;
+	}
+
+	/* remember the last record passed to the system log, so it is not passed
+	 * again after a restart */
+	if (false == kmsg_save(kmsg, queue->sequences[sent - 1])) {
+		return false;
+	}
+
+	queue->count -= (unsigned int) sent;
+	if (0 < queue->count) {
+		(void) memmove(queue->messages,
+		               queue->messages[sent],
+		               queue->count * sizeof(queue->messages[0]));
+		(void) memmove(queue->lengths,
+		               &queue->lengths[sent],
+		               queue->count * sizeof(queue->lengths[0]));
+		(void) memmove(queue->sequences,
+		               &queue->sequences[sent],
+		               queue->count * sizeof(queue->sequences[0]));
+	}
+
+	return true;
+}
+
 int main(int argc, char *argv[]) {
-	/* a log message */
-	char message[1 + MAX_MESSAGE_LENGTH] = {'\0'};
+	/* the kernel log */
+	static kmsg_t kmsg = {0};
+
+	/* messages waiting to be sent */
+	static queue_t queue = {{0}};
 
-	/* the message size */
-	int size = 0;
+	/* groups of similar messages */
+	static storm_t storm = {{{0}}};
 
-	/* the message priority */
-	int priority = 0;
+	/* a kernel log record */
+	kmsg_record_t record = {0};
 
-	/* the message offset */
-	unsigned int offset = 0;
+	/* a report of suppressed messages */
+	kmsg_record_t report = {0};
+
+	/* the current monotonic time, in milliseconds */
+	uint64_t now = 0;
+
+	/* the time left until suppressed messages are reported, in
+	 * milliseconds */
+	int storm_timeout = 0;
+
+	/* whether suppressed messages should be reported */
+	bool is_reported = false;
+
+	/* the message timestamp */
+	char timestamp[32] = {'\0'};
+
+	/* the time to wait for new records, in milliseconds */
+	int timeout = 0;
+
+	/* the result of reading a record */
+	int result = 0;
 
 	/* the exit code */
 	int exit_code = EXIT_FAILURE;
@@ -34,61 +235,123 @@ int main(int argc, char *argv[]) {
 	}
 
 	/* open the kernel log */
-	if (-1 == klogctl(1, NULL, 0)) {
+	if (false == kmsg_open(&kmsg, STATE_PATH)) {
 		goto end;
 	}
 
 	/* disable output of kernel messages to the console */
 	if (-1 == klogctl(6, NULL, 0)) {
-		goto end;
+		goto close_kernel_log;
 	}
 
-	/* open the system log */
-	openlog("kernel", LOG_NDELAY, LOG_KERN);
-
 	/* daemonize */
 	if (false == daemon_daemonize(DAEMON_WORKING_DIRECTORY, NULL)) {
-		goto close_log;
+		goto enable_console;
 	}
 
+	/* connect to the system log; if it is not running yet, messages are kept
+	 * until it is */
+	queue.fd = -1;
+	(void) _connect(&queue);
+
+	storm_init(&storm);
+
 	do {
-		/* read a log message */
-		size = klogctl(2, message, sizeof(message));
-		switch (size) {
-			case (-1):
-				goto close_log;
+		_get_timestamp(timestamp, sizeof(timestamp));
+		now = _get_now();
 
-			case 0:
+		/* report messages suppressed in windows which have passed; they
+		 * belong to records already read */
+		while (((QUEUE_SIZE - 1) > queue.count) &&
+		       (true == storm_expire(&storm, now, &report))) {
+			report.sequence = kmsg.next - 1;
+			_push_record(&queue, &report, timestamp);
+		}
+
+		/* format new records, until there is no room for more; the reports
+		 * of lost and suppressed records may need room as well */
+		while ((QUEUE_SIZE - 2) > queue.count) {
+			result = kmsg_read(&kmsg, &record);
+			if (-1 == result) {
+				goto disconnect;
+			}
+			if (0 == result) {
+				break;
+			}
+
+			/* report records lost before this one */
+			if (0 < kmsg.lost) {
+				_push(&queue,
+				      record.sequence - 1,
+				      snprintf(queue.messages[queue.count],
+				               sizeof(queue.messages[0]),
+				               LOST_MESSAGE,
+				               LOG_KERN | LOG_WARNING,
+				               timestamp,
+				               kmsg.lost));
+				kmsg.lost = 0;
+			}
+
+			/* during a storm of similar messages, pass only the first
+			 * ones and report the number of others later */
+			if (true == storm_is_suppressed(&storm,
+			                                &record,
+			                                &report,
+			                                &is_reported)) {
 				continue;
+			}
+			if (true == is_reported) {
+				report.sequence = record.sequence - 1;
+				_push_record(&queue, &report, timestamp);
+			}
+
+			_push_record(&queue, &record, timestamp);
 		}
 
-		/* parse the message priority */
-		priority = LOG_INFO;
-		if (3 >= size) {
-			offset = 0;
+		/* send all formatted messages at once */
+		if ((0 < queue.count) && (false == _send(&queue, &kmsg))) {
+			goto disconnect;
+		}
+
+		/* if messages could not be sent, try again later; meanwhile, new
+		 * records are kept by the kernel */
+		if (0 < queue.count) {
+			timeout = RETRY_INTERVAL;
+			if ((QUEUE_SIZE - 2) <= queue.count) {
+				(void) usleep(RETRY_INTERVAL * 1000);
+				continue;
+			}
 		} else {
-			if (('<' == message[0]) && ('>' == message[2])) {
-				priority = message[1] - '0';
-				offset = 3;
+			if (0 != result) {
+				continue;
 			}
+			timeout = -1;
 		}
 
-		/* terminate the log message */
-		message[size] = '\0';
-
-		/* write the message to the system log */
-		syslog(priority, "%s", message + offset);
+		/* wake up when suppressed messages should be reported */
+		storm_timeout = storm_get_timeout(&storm, _get_now());
+		if ((-1 != storm_timeout) &&
+		    ((-1 == timeout) || (timeout > storm_timeout))) {
+			timeout = storm_timeout;
+		}
+		if (false == kmsg_wait(&kmsg, timeout)) {
+			goto disconnect;
+		}
 	} while (1);
 
-close_log:
-	/* close the system log */
-	closelog();
+disconnect:
+	/* disconnect from the system log */
+	if (-1 != queue.fd) {
+		(void) close(queue.fd);
+	}
 
+enable_console:
 	/* re-enable output of kernel log messages */
 	(void) klogctl(7, NULL, 0);
 
+close_kernel_log:
 	/* close the kernel log */
-	(void) klogctl(0, NULL, 0);
+	kmsg_close(&kmsg);
 
 end:
 	return exit_code;
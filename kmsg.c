@@ -0,0 +1,231 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "kmsg.h"
+
+/* the state file permissions */
+#define STATE_FILE_PERMISSIONS (0644)
+
+/* the state file format: the sequence number of the last record read, padded
+ * so the file never shrinks */
+#define STATE_FORMAT "%020" PRIu64 "\n"
+
+/* the state file length */
+#define STATE_LENGTH (21)
+
+static bool _parse_number(const char **position, uint64_t *value) {
+	/* the end of the number */
+	char *end = NULL;
+
+	assert(NULL != position);
+	assert(NULL != value);
+
+	/* each field ends with a comma, except the last one, which ends with a
+	 * semicolon */
+	*value = (uint64_t) strtoull(*position, &end, 10);
+	if ((*position == end) || ((',' != end[0]) && (';' != end[0]))) {
+		return false;
+	}
+	*position = end;
+
+	return true;
+}
+
+static bool _parse(const char *buffer,
+                   const size_t size,
+                   kmsg_record_t *record) {
+	/* the parsing position */
+	const char *position = buffer;
+
+	/* the end of the message */
+	const char *end = NULL;
+
+	/* the message priority and facility */
+	uint64_t value = 0;
+
+	assert(NULL != buffer);
+	assert(NULL != record);
+
+	/* each record starts with the priority, the sequence number and the
+	 * monotonic timestamp, in microseconds, followed by other fields */
+	if ((false == _parse_number(&position, &value)) ||
+	    (',' != position[0])) {
+		return false;
+	}
+	record->facility = (int) (value >> 3);
+	record->priority = (int) (value & 7);
+	++position;
+	if ((false == _parse_number(&position, &record->sequence)) ||
+	    (',' != position[0])) {
+		return false;
+	}
+	++position;
+	if (false == _parse_number(&position, &record->timestamp)) {
+		return false;
+	}
+
+	/* the message follows the semicolon and ends with a line break, which
+	 * may be followed by properties of the record */
+	position = memchr(position, ';', size - (size_t) (position - buffer));
+	if (NULL == position) {
+		return false;
+	}
+	++position;
+	end = memchr(position, '\n', size - (size_t) (position - buffer));
+	if (NULL == end) {
+		end = &buffer[size];
+	}
+
+	record->length = (size_t) (end - position);
+	if (KMSG_MAX_MESSAGE_LENGTH < record->length) {
+		record->length = KMSG_MAX_MESSAGE_LENGTH;
+	}
+	(void) memcpy(record->text, position, record->length);
+	record->text[record->length] = '\0';
+
+	return true;
+}
+
+static void _load(kmsg_t *kmsg) {
+	/* the state */
+	char state[1 + STATE_LENGTH] = {'\0'};
+
+	/* the end of the sequence number */
+	char *end = NULL;
+
+	/* the sequence number of the last record read */
+	uint64_t last = 0;
+
+	/* the state size */
+	ssize_t size = 0;
+
+	assert(NULL != kmsg);
+
+	/* if there is no state, or it is corrupt, start from the oldest
+	 * record */
+	size = pread(kmsg->state_fd, state, STATE_LENGTH, 0);
+	if (STATE_LENGTH != size) {
+		return;
+	}
+	last = (uint64_t) strtoull(state, &end, 10);
+	if ('\n' != end[0]) {
+		return;
+	}
+
+	kmsg->next = 1 + last;
+	kmsg->is_known = true;
+}
+
+bool kmsg_open(kmsg_t *kmsg, const char *state_path) {
+	assert(NULL != kmsg);
+	assert(NULL != state_path);
+
+	kmsg->next = 0;
+	kmsg->lost = 0;
+	kmsg->is_known = false;
+
+	/* open the kernel log; it is read from the oldest record */
+	kmsg->fd = open(KMSG_PATH, O_RDONLY | O_NONBLOCK);
+	if (-1 == kmsg->fd) {
+		return false;
+	}
+
+	/* continue after the last record read by a previous instance; the state
+	 * is kept under /run, so it does not survive a reboot, like the kernel
+	 * log */
+	kmsg->state_fd = open(state_path,
+	                      O_RDWR | O_CREAT,
+	                      STATE_FILE_PERMISSIONS);
+	if (-1 == kmsg->state_fd) {
+		(void) close(kmsg->fd);
+		return false;
+	}
+	_load(kmsg);
+
+	return true;
+}
+
+void kmsg_close(kmsg_t *kmsg) {
+	assert(NULL != kmsg);
+
+	(void) close(kmsg->state_fd);
+	(void) close(kmsg->fd);
+}
+
+int kmsg_read(kmsg_t *kmsg, kmsg_record_t *record) {
+	/* the record size */
+	ssize_t size = 0;
+
+	assert(NULL != kmsg);
+	assert(NULL != record);
+
+	do {
+		/* each read returns one record; if records were overwritten before
+		 * they were read, the read fails with EPIPE and the next one
+		 * returns the oldest record left */
+		size = read(kmsg->fd, kmsg->buffer, sizeof(kmsg->buffer));
+		if (-1 == size) {
+			switch (errno) {
+				case EAGAIN:
+					return 0;
+
+				case EPIPE:
+				case EINTR:
+					continue;
+
+				default:
+					return -1;
+			}
+		}
+
+		if (false == _parse(kmsg->buffer, (size_t) size, record)) {
+			continue;
+		}
+
+		/* skip records read before; count the records missed, through the
+		 * gap in sequence numbers */
+		if (true == kmsg->is_known) {
+			if (kmsg->next > record->sequence) {
+				continue;
+			}
+			kmsg->lost += record->sequence - kmsg->next;
+		}
+		kmsg->next = 1 + record->sequence;
+		kmsg->is_known = true;
+
+		return 1;
+	} while (1);
+}
+
+bool kmsg_wait(const kmsg_t *kmsg, const int timeout) {
+	/* the polled file descriptor */
+	struct pollfd poll_fd = {0};
+
+	assert(NULL != kmsg);
+
+	/* wait until a record is added, or the timeout, in milliseconds, expires;
+	 * a negative timeout means no timeout */
+	poll_fd.fd = kmsg->fd;
+	poll_fd.events = POLLIN;
+	return ((-1 != poll(&poll_fd, 1, timeout)) || (EINTR == errno));
+}
+
+bool kmsg_save(const kmsg_t *kmsg, const uint64_t sequence) {
+	/* the state */
+	char state[1 + STATE_LENGTH] = {'\0'};
+
+	assert(NULL != kmsg);
+
+	/* the state is overwritten in place, with one write */
+	(void) snprintf(state, sizeof(state), STATE_FORMAT, sequence);
+	return (STATE_LENGTH == pwrite(kmsg->state_fd, state, STATE_LENGTH, 0));
+}
@@ -0,0 +1,45 @@
+#ifndef _KMSG_H_INCLUDED
+#	define _KMSG_H_INCLUDED
+
+#	include <stdint.h>
+#	include <stdbool.h>
+#	include <sys/types.h>
+
+#	include "common.h"
+
+/* the kernel log device */
+#	define KMSG_PATH "/dev/kmsg"
+
+/* the maximum size of a kernel log record, including its properties */
+#	define KMSG_RECORD_SIZE (8192)
+
+/* the maximum length of a kernel log message */
+#	define KMSG_MAX_MESSAGE_LENGTH (MAX_LENGTH)
+
+typedef struct {
+	uint64_t sequence;
+	uint64_t timestamp;
+	size_t length;
+	int facility;
+	int priority;
+	char text[1 + KMSG_MAX_MESSAGE_LENGTH];
+} kmsg_record_t;
+
+typedef struct {
+	uint64_t next;
+	uint64_t lost;
+	int fd;
+	int state_fd;
+	bool is_known;
+	char buffer[KMSG_RECORD_SIZE];
+} kmsg_t;
+
+bool kmsg_open(kmsg_t *kmsg, const char *state_path);
+void kmsg_close(kmsg_t *kmsg);
+
+int kmsg_read(kmsg_t *kmsg, kmsg_record_t *record);
+bool kmsg_wait(const kmsg_t *kmsg, const int timeout);
+
+bool kmsg_save(const kmsg_t *kmsg, const uint64_t sequence);
+
+#endif
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <syslog.h>
+#include <assert.h>
+
+#include "limit.h"
+
+/* the report of suppressed messages */
+#define REPORT_FORMAT "<%d>syslogd: %u messages from process %ld (user %ld) " \
+                      "were suppressed"
+
+/* the report of suppressed messages of senders no longer tracked */
+#define OTHERS_REPORT_FORMAT "<%d>syslogd: %u messages from other processes " \
+                             "were suppressed"
+
+static double _get_elapsed(const struct timespec *since,
+                           const struct timespec *now) {
+	assert(NULL != since);
+	assert(NULL != now);
+
+	/* return the elapsed time in seconds, without rounding it, so senders
+	 * of frequent messages are not refilled less than they should be */
+	return (double) (now->tv_sec - since->tv_sec) +
+	       ((double) (now->tv_nsec - since->tv_nsec) / 1e9);
+}
+
+void limit_init(limit_t *limit, const double rate, const double burst) {
+	/* a loop index */
+	unsigned int i = 0;
+
+	assert(NULL != limit);
+
+	limit->rate = rate;
+	limit->burst = burst;
+	limit->suppressed = 0;
+	for (i = 0; MAX_SENDERS > i; ++i) {
+		limit->senders[i].is_used = false;
+	}
+}
+
+bool limit_take(limit_t *limit,
+                const struct ucred *credentials,
+                const struct timespec *now) {
+	/* the sender state */
+	sender_t *sender = NULL;
+
+	/* a loop index */
+	unsigned int i = 0;
+
+	assert(NULL != limit);
+	assert(NULL != credentials);
+	assert(NULL != now);
+
+	/* if there is no limit, accept all messages */
+	if (0 >= limit->rate) {
+		return true;
+	}
+
+	/* look for the sender; if it is not there, replace the least recently
+	 * active sender */
+	sender = &limit->senders[0];
+	for (i = 0; MAX_SENDERS > i; ++i) {
+		if ((true == limit->senders[i].is_used) &&
+		    (credentials->pid == limit->senders[i].pid)) {
+			sender = &limit->senders[i];
+			break;
+		}
+		if (false == limit->senders[i].is_used) {
+			sender = &limit->senders[i];
+			continue;
+		}
+		if ((true == sender->is_used) &&
+		    (0 < _get_elapsed(&limit->senders[i].updated,
+		                      &sender->updated))) {
+			sender = &limit->senders[i];
+		}
+	}
+
+	/* senders seen for the first time start with a full bucket */
+	if ((false == sender->is_used) || (credentials->pid != sender->pid)) {
+		if (true == sender->is_used) {
+			limit->suppressed += sender->suppressed;
+		}
+		sender->pid = credentials->pid;
+		sender->uid = credentials->uid;
+		sender->tokens = limit->burst;
+		sender->updated = *now;
+		sender->suppressed = 0;
+		sender->is_used = true;
+	}
+
+	/* refill the bucket, according to the time passed since the last
+	 * message */
+	sender->tokens += limit->rate * _get_elapsed(&sender->updated, now);
+	if (limit->burst < sender->tokens) {
+		sender->tokens = limit->burst;
+	}
+	sender->updated = *now;
+
+	/* if the bucket is empty, the message exceeds the rate limit */
+	if (1 > sender->tokens) {
+		++sender->suppressed;
+		return false;
+	}
+
+	--sender->tokens;
+	return true;
+}
+
+bool limit_report(limit_t *limit, char *report, const size_t size) {
+	/* a loop index */
+	unsigned int i = 0;
+
+	assert(NULL != limit);
+	assert(NULL != report);
+
+	/* report one sender with suppressed messages at a time */
+	for (i = 0; MAX_SENDERS > i; ++i) {
+		if ((false == limit->senders[i].is_used) ||
+		    (0 == limit->senders[i].suppressed)) {
+			continue;
+		}
+		(void) snprintf(report,
+		                size,
+		                REPORT_FORMAT,
+		                LOG_SYSLOG | LOG_WARNING,
+		                limit->senders[i].suppressed,
+		                (long) limit->senders[i].pid,
+		                (long) limit->senders[i].uid);
+		limit->senders[i].suppressed = 0;
+		return true;
+	}
+
+	if (0 < limit->suppressed) {
+		(void) snprintf(report,
+		                size,
+		                OTHERS_REPORT_FORMAT,
+		                LOG_SYSLOG | LOG_WARNING,
+		                limit->suppressed);
+		limit->suppressed = 0;
+		return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,35 @@
+#ifndef _LIMIT_H_INCLUDED
+#	define _LIMIT_H_INCLUDED
+
+#	include <stdbool.h>
+#	include <sys/types.h>
+#	include <sys/socket.h>
+#	include <time.h>
+
+/* the number of senders tracked */
+#	define MAX_SENDERS (64)
+
+typedef struct {
+	struct timespec updated;
+	double tokens;
+	pid_t pid;
+	uid_t uid;
+	unsigned int suppressed;
+	bool is_used;
+} sender_t;
+
+typedef struct {
+	sender_t senders[MAX_SENDERS];
+	double rate;
+	double burst;
+	unsigned int suppressed;
+} limit_t;
+
+void limit_init(limit_t *limit, const double rate, const double burst);
+
+bool limit_take(limit_t *limit,
+                const struct ucred *credentials,
+                const struct timespec *now);
+bool limit_report(limit_t *limit, char *report, const size_t size);
+
+#endif
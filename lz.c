@@ -0,0 +1,299 @@
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "lz.h"
+
+/* the minimum length of a match */
+#define MIN_MATCH (4)
+
+/* the number of bits of the hash of the bytes a match starts with */
+#define HASH_BITS (12)
+
+/* the maximum match offset */
+#define MAX_OFFSET (0xFFFF)
+
+/* the length which indicates more length bytes follow */
+#define MORE_LENGTH (15)
+
+/* the number of bytes skipped when no matches are found for a while grows
+ * every 64 bytes */
+#define SKIP_SHIFT (6)
+
+/* each sequence starts with a token: the number of literals in the high 4 bits
+ * and the match length, minus MIN_MATCH, in the low 4 bits; lengths of 15 or
+ * more continue in the following bytes, which are added until one is not 255.
+ * The literals follow, then the match offset, in 2 bytes. The last sequence
+ * has no match. */
+
+static uint32_t _read32(const char *position) {
+	/* the bytes */
+	uint32_t value = 0;
+
+	/* memcpy() avoids unaligned access and is optimized away */
+	(void) memcpy(&value, position, sizeof(value));
+	return value;
+}
+
+static unsigned int _hash(const uint32_t value) {
+	return (unsigned int) ((value * 2654435761U) >> (32 - HASH_BITS));
+}
+
+static bool _put_length(char *destination,
+                        size_t *offset,
+                        const size_t capacity,
+                        size_t length) {
+	for ( ; 255 <= length; length -= 255) {
+		if (capacity <= *offset) {
+			return false;
+		}
+		destination[*offset] = (char) 255;
+		++*offset;
+	}
+
+	if (capacity <= *offset) {
+		return false;
+	}
+	destination[*offset] = (char) length;
+	++*offset;
+	return true;
+}
+
+static bool _put_sequence(char *destination,
+                          size_t *offset,
+                          const size_t capacity,
+                          const char *literals,
+                          const size_t literals_length,
+                          const size_t match_offset,
+                          const size_t match_length) {
+	/* the token */
+	unsigned int token = 0;
+
+	/* the match length, without the minimum */
+	size_t length = 0;
+
+	if (capacity <= *offset) {
+		return false;
+	}
+
+	token = (MORE_LENGTH <= literals_length) ?
+	        MORE_LENGTH :
+	        (unsigned int) literals_length;
+	token <<= 4;
+	if (0 < match_length) {
+		length = match_length - MIN_MATCH;
+		token |= (MORE_LENGTH <= length) ?
+		         MORE_LENGTH :
+		         (unsigned int) length;
+	}
+	destination[*offset] = (char) token;
+	++*offset;
+
+	if ((MORE_LENGTH <= literals_length) &&
+	    (false == _put_length(destination,
+	                          offset,
+	                          capacity,
+	                          literals_length - MORE_LENGTH))) {
+		return false;
+	}
+	if ((capacity - *offset) < literals_length) {
+		return false;
+	}
+	(void) memcpy(&destination[*offset], literals, literals_length);
+	*offset += literals_length;
+
+	/* the last sequence has no match */
+	if (0 == match_length) {
+		return true;
+	}
+
+	if ((capacity - *offset) < 2) {
+		return false;
+	}
+	destination[*offset] = (char) (match_offset & 0xFF);
+	destination[1 + *offset] = (char) (match_offset >> 8);
+	*offset += 2;
+
+	return ((MORE_LENGTH > length) ||
+	        (true == _put_length(destination,
+	                             offset,
+	                             capacity,
+	                             length - MORE_LENGTH)));
+}
+
+size_t lz_compress(const char *source,
+                   const size_t size,
+                   char *destination,
+                   const size_t capacity) {
+	/* the last position of each hash */
+	uint32_t table[1 << HASH_BITS] = {0};
+
+	/* the current position */
+	size_t position = 0;
+
+	/* the position of the first literal not compressed yet */
+	size_t anchor = 0;
+
+	/* the position of a possible match */
+	size_t candidate = 0;
+
+	/* the match length */
+	size_t length = 0;
+
+	/* the compressed size */
+	size_t offset = 0;
+
+	/* the hash of the current position */
+	unsigned int hash = 0;
+
+	assert(NULL != source);
+	assert(NULL != destination);
+	assert(LZ_MAX_SIZE >= size);
+
+	/* find matches of at least MIN_MATCH bytes, through the last position
+	 * with the same hash */
+	while ((size >= MIN_MATCH) && ((size - MIN_MATCH) >= position)) {
+		hash = _hash(_read32(&source[position]));
+		candidate = (size_t) table[hash];
+		table[hash] = (uint32_t) position;
+
+		if ((candidate >= position) ||
+		    (MAX_OFFSET < (position - candidate)) ||
+		    (_read32(&source[candidate]) != _read32(&source[position]))) {
+			/* skip incompressible data faster */
+			position += 1 + ((position - anchor) >> SKIP_SHIFT);
+			continue;
+		}
+
+		for (length = MIN_MATCH;
+		     (size > (position + length)) &&
+		     (source[candidate + length] == source[position + length]);
+		     ++length);
+
+		if (false == _put_sequence(destination,
+		                           &offset,
+		                           capacity,
+		                           &source[anchor],
+		                           position - anchor,
+		                           position - candidate,
+		                           length)) {
+			return 0;
+		}
+		position += length;
+		anchor = position;
+	}
+
+	/* the remaining bytes are literals */
+	if (false == _put_sequence(destination,
+	                           &offset,
+	                           capacity,
+	                           &source[anchor],
+	                           size - anchor,
+	                           0,
+	                           0)) {
+		return 0;
+	}
+
+	return offset;
+}
+
+static bool _get_length(const char *source,
+                        const size_t size,
+                        size_t *offset,
+                        size_t *length) {
+	/* a length byte */
+	unsigned char byte = 0;
+
+	do {
+		if (size <= *offset) {
+			return false;
+		}
+		byte = (unsigned char) source[*offset];
+		++*offset;
+		*length += byte;
+	} while (255 == byte);
+
+	return true;
+}
+
+bool lz_decompress(const char *source,
+                   const size_t size,
+                   char *destination,
+                   const size_t expected) {
+	/* the offset of the current sequence */
+	size_t offset = 0;
+
+	/* the decompressed size */
+	size_t position = 0;
+
+	/* the number of literals */
+	size_t literals_length = 0;
+
+	/* the match offset and length */
+	size_t match_offset = 0;
+	size_t length = 0;
+
+	/* a loop index */
+	size_t i = 0;
+
+	/* the start of the match */
+	const char *match = NULL;
+
+	/* the token */
+	unsigned int token = 0;
+
+	assert(NULL != source);
+	assert(NULL != destination);
+
+	/* stop at anything which does not fit, so corrupt data is never written
+	 * outside the destination */
+	while (size > offset) {
+		token = (unsigned char) source[offset];
+		++offset;
+
+		literals_length = token >> 4;
+		if ((MORE_LENGTH == literals_length) &&
+		    (false == _get_length(source, size, &offset, &literals_length))) {
+			return false;
+		}
+		if (((size - offset) < literals_length) ||
+		    ((expected - position) < literals_length)) {
+			return false;
+		}
+		(void) memcpy(&destination[position], &source[offset], literals_length);
+		offset += literals_length;
+		position += literals_length;
+
+		/* the last sequence has no match */
+		if (size == offset) {
+			break;
+		}
+
+		if ((size - offset) < 2) {
+			return false;
+		}
+		match_offset = (size_t) (unsigned char) source[offset] |
+		               ((size_t) (unsigned char) source[1 + offset] << 8);
+		offset += 2;
+		length = token & MORE_LENGTH;
+		if ((MORE_LENGTH == length) &&
+		    (false == _get_length(source, size, &offset, &length))) {
+			return false;
+		}
+		length += MIN_MATCH;
+		if ((0 == match_offset) ||
+		    (position < match_offset) ||
+		    ((expected - position) < length)) {
+			return false;
+		}
+
+		/* the match may overlap the bytes it produces */
+		match = &destination[position - match_offset];
+		for (i = 0; length > i; ++i) {
+			destination[position + i] = match[i];
+		}
+		position += length;
+	}
+
+	return (expected == position);
+}
@@ -0,0 +1,20 @@
+#ifndef _LZ_H_INCLUDED
+#	define _LZ_H_INCLUDED
+
+#	include <stdbool.h>
+#	include <sys/types.h>
+
+/* the maximum size of data compressed at once, so match offsets fit in 16
+ * bits */
+#	define LZ_MAX_SIZE (64 * 1024)
+
+size_t lz_compress(const char *source,
+                   const size_t size,
+                   char *destination,
+                   const size_t capacity);
+bool lz_decompress(const char *source,
+                   const size_t size,
+                   char *destination,
+                   const size_t expected);
+
+#endif
@@ -0,0 +1,150 @@
+#include <string.h>
+#include <syslog.h>
+#include <assert.h>
+
+#include "message.h"
+
+/* the length of a RFC 3164 timestamp, e.g "Jan  1 00:00:00 " */
+#define TIMESTAMP_LENGTH (16)
+
+size_t message_parse_priority(const char *text,
+                              const size_t length,
+                              int *facility,
+                              int *priority) {
+	/* the <PRI> prefix value */
+	int value = 0;
+
+	/* a loop index */
+	size_t i = 1;
+
+	assert(NULL != text);
+	assert(NULL != facility);
+	assert(NULL != priority);
+
+	/* if there is no <PRI> prefix, assume LOG_USER and LOG_INFO */
+	*facility = LOG_FAC(LOG_USER);
+	*priority = LOG_INFO;
+	if ((3 > length) || ('<' != text[0])) {
+		return 0;
+	}
+
+	/* parse the prefix; stop as soon as it exceeds the largest valid value,
+	 * so it cannot overflow */
+	for ( ; (length > i) && ('>' != text[i]); ++i) {
+		if (('0' > text[i]) || ('9' < text[i])) {
+			return 0;
+		}
+		value = (value * 10) + (text[i] - '0');
+		if ((LOG_FACMASK | LOG_PRIMASK) < value) {
+			return 0;
+		}
+	}
+	if ((length == i) ||
+	    (1 == i) ||
+	    (LOG_FAC(LOG_LOCAL7) < LOG_FAC(value))) {
+		return 0;
+	}
+
+	*facility = LOG_FAC(value);
+	*priority = LOG_PRI(value);
+	return 1 + i;
+}
+
+void message_parse_tag(const char *text,
+                       const size_t length,
+                       size_t offset,
+                       size_t *tag_offset,
+                       size_t *tag_length) {
+	/* a loop index */
+	size_t i = 0;
+
+	assert(NULL != text);
+	assert(NULL != tag_offset);
+	assert(NULL != tag_length);
+
+	/* skip the timestamp, if there is one */
+	if (((offset + TIMESTAMP_LENGTH) <= length) &&
+	    (' ' == text[offset + 3]) &&
+	    (':' == text[offset + 9]) &&
+	    (':' == text[offset + 12]) &&
+	    (' ' == text[offset + 15])) {
+		offset += TIMESTAMP_LENGTH;
+	}
+
+	/* the tag ends with a process ID or a colon */
+	for (i = offset; (length > i) && (MAX_TAG_LENGTH > (i - offset)); ++i) {
+		if (('[' == text[i]) || (':' == text[i]) || (' ' == text[i])) {
+			break;
+		}
+	}
+
+	*tag_offset = offset;
+	*tag_length = i - offset;
+}
+
+void message_init(message_t *message, const char *text, const size_t length) {
+	assert(NULL != message);
+	assert(NULL != text);
+	assert(sizeof(message->text) > length);
+
+	/* copy the message */
+	(void) memcpy(message->text, text, length);
+	message->text[length] = '\0';
+	message->length = length;
+
+	/* stamp the message with the time it was received */
+	if (-1 == clock_gettime(CLOCK_REALTIME, &message->realtime)) {
+		message->realtime.tv_sec = 0;
+		message->realtime.tv_nsec = 0;
+	}
+	if (-1 == clock_gettime(CLOCK_MONOTONIC, &message->monotonic)) {
+		message->monotonic.tv_sec = 0;
+		message->monotonic.tv_nsec = 0;
+	}
+
+	/* parse the <PRI> prefix and the tag following it */
+	message_parse_tag(message->text,
+	                  message->length,
+	                  message_parse_priority(message->text,
+	                                         message->length,
+	                                         &message->facility,
+	                                         &message->priority),
+	                  &message->tag_offset,
+	                  &message->tag_length);
+}
+
+void message_label(message_t *message,
+                   const char *label,
+                   const size_t label_length) {
+	/* the length of the label prefix */
+	size_t prefix_length = 0;
+
+	/* the length of the text moved after the prefix */
+	size_t moved = 0;
+
+	assert(NULL != message);
+	assert(NULL != label);
+
+	/* prefix the tag with the label; if the message becomes too long, its
+	 * end is truncated */
+	prefix_length = 1 + label_length;
+	if (MAX_MESSAGE_LENGTH < (message->tag_offset + prefix_length)) {
+		return;
+	}
+	moved = message->length - message->tag_offset;
+	if (MAX_MESSAGE_LENGTH < (message->length + prefix_length)) {
+		moved = MAX_MESSAGE_LENGTH - message->tag_offset - prefix_length;
+	}
+	(void) memmove(&message->text[message->tag_offset + prefix_length],
+	               &message->text[message->tag_offset],
+	               moved);
+	(void) memcpy(&message->text[message->tag_offset], label, label_length);
+	message->text[message->tag_offset + label_length] = LABEL_SEPARATOR;
+	message->length = message->tag_offset + prefix_length + moved;
+	message->text[message->length] = '\0';
+
+	message->tag_length += prefix_length;
+	if (MAX_TAG_LENGTH < message->tag_length) {
+		message->tag_length = MAX_TAG_LENGTH;
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef _MESSAGE_H_INCLUDED
+#	define _MESSAGE_H_INCLUDED
+
+#	include <sys/types.h>
+#	include <time.h>
+
+#	include "syslog.h"
+
+/* the maximum length of a message tag */
+#	define MAX_TAG_LENGTH (32)
+
+/* the separator between the label of a message source and the tag */
+#	define LABEL_SEPARATOR '/'
+
+typedef struct {
+	struct timespec realtime;
+	struct timespec monotonic;
+	size_t length;
+	size_t tag_offset;
+	size_t tag_length;
+	int facility;
+	int priority;
+	char text[1 + MAX_MESSAGE_LENGTH];
+} message_t;
+
+size_t message_parse_priority(const char *text,
+                              const size_t length,
+                              int *facility,
+                              int *priority);
+void message_parse_tag(const char *text,
+                       const size_t length,
+                       size_t offset,
+                       size_t *tag_offset,
+                       size_t *tag_length);
+void message_init(message_t *message, const char *text, const size_t length);
+void message_label(message_t *message,
+                   const char *label,
+                   const size_t label_length);
+
+#endif
@@ -0,0 +1,309 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sched.h>
+#include <assert.h>
+
+#include "syslog.h"
+#include "codec.h"
+#include "mirror.h"
+
+/* the shared file permissions */
+#define MIRROR_FILE_PERMISSIONS (0644)
+
+/* the shared file size */
+#define MIRROR_FILE_SIZE (MIRROR_DATA_OFFSET + MIRROR_SIZE)
+
+/* the number of attempts to copy the ring while a message is published,
+ * before the publisher is assumed to have crashed */
+#define MIRROR_RETRIES (1000)
+
+/* the maximum number of attempts to copy the ring, after which it is assumed
+ * to be corrupt or published too often to be copied */
+#define MIRROR_MAX_ATTEMPTS (2 * MIRROR_RETRIES)
+
+/* the length of each message precedes it in the ring */
+typedef uint32_t entry_length_t;
+
+static void _copy_in(char *data,
+                     const uint64_t position,
+                     const char *source,
+                     const size_t size,
+                     const bool is_encoded) {
+	/* the offset of the position in the ring */
+	size_t offset = (size_t) (position % MIRROR_SIZE);
+
+	/* the size of the part before the end of the ring */
+	size_t first = MIRROR_SIZE - offset;
+
+	if (size < first) {
+		first = size;
+	}
+
+	/* messages are encoded like the system log */
+	if (true == is_encoded) {
+		codec_xor(&data[offset], source, first);
+		codec_xor(data, &source[first], size - first);
+	} else {
+		(void) memcpy(&data[offset], source, first);
+		(void) memcpy(data, &source[first], size - first);
+	}
+}
+
+static void _copy_out(const char *data,
+                      const uint64_t position,
+                      char *destination,
+                      const size_t size) {
+	/* the offset of the position in the ring */
+	size_t offset = (size_t) (position % MIRROR_SIZE);
+
+	/* the size of the part before the end of the ring */
+	size_t first = MIRROR_SIZE - offset;
+
+	if (size < first) {
+		first = size;
+	}
+
+	(void) memcpy(destination, &data[offset], first);
+	(void) memcpy(&destination[first], data, size - first);
+}
+
+static bool _map(mirror_t *mirror, const int protection) {
+	/* the shared file contents */
+	char *contents = NULL;
+
+	assert(NULL != mirror);
+
+	contents = mmap(NULL,
+	                MIRROR_FILE_SIZE,
+	                protection,
+	                MAP_SHARED,
+	                mirror->fd,
+	                0);
+	if (MAP_FAILED == contents) {
+		return false;
+	}
+
+	mirror->header = (mirror_header_t *) contents;
+	mirror->data = &contents[MIRROR_DATA_OFFSET];
+	return true;
+}
+
+static bool _is_valid(const mirror_header_t *header) {
+	assert(NULL != header);
+
+	return ((0 == memcmp(header->magic, MIRROR_MAGIC, MIRROR_MAGIC_SIZE)) &&
+	        (MIRROR_SIZE == header->size) &&
+	        (header->tail <= header->head) &&
+	        (MIRROR_SIZE >= (header->head - header->tail)));
+}
+
+bool mirror_open(mirror_t *mirror, const char *path) {
+	/* the shared file attributes */
+	struct stat attributes = {0};
+
+	assert(NULL != mirror);
+	assert(NULL != path);
+
+	/* the shared file is kept under /run, so recent messages survive a
+	 * crash or a restart, but not a reboot */
+	mirror->fd = open(path,
+	                  O_RDWR | O_CREAT | O_CLOEXEC,
+	                  MIRROR_FILE_PERMISSIONS);
+	if (-1 == mirror->fd) {
+		return false;
+	}
+	if ((-1 == fstat(mirror->fd, &attributes)) ||
+	    ((MIRROR_FILE_SIZE != attributes.st_size) &&
+	     (-1 == ftruncate(mirror->fd, MIRROR_FILE_SIZE)))) {
+		goto close_file;
+	}
+
+	if (false == _map(mirror, PROT_READ | PROT_WRITE)) {
+		goto close_file;
+	}
+
+	/* keep the messages published by a previous instance; if it crashed
+	 * while publishing a message, the messages before it are intact */
+	if (false == _is_valid(mirror->header)) {
+		(void) memset(mirror->header, 0, sizeof(*mirror->header));
+		mirror->header->size = MIRROR_SIZE;
+		(void) memcpy(mirror->header->magic, MIRROR_MAGIC, MIRROR_MAGIC_SIZE);
+	} else if (0 != (mirror->header->sequence & 1)) {
+		++mirror->header->sequence;
+	}
+
+	return true;
+
+close_file:
+	(void) close(mirror->fd);
+	return false;
+}
+
+void mirror_close(mirror_t *mirror) {
+	assert(NULL != mirror);
+
+	(void) munmap((void *) mirror->header, MIRROR_FILE_SIZE);
+	(void) close(mirror->fd);
+}
+
+void mirror_publish(mirror_t *mirror, const char *text, const size_t length) {
+	/* the message length */
+	entry_length_t entry_length = (entry_length_t) length;
+
+	/* the sequence number */
+	uint64_t sequence = 0;
+
+	/* the position of the oldest message */
+	uint64_t tail = 0;
+
+	/* the position of the next message */
+	uint64_t head = 0;
+
+	assert(NULL != mirror);
+	assert(NULL != text);
+	assert(MIRROR_SIZE > (sizeof(entry_length) + length));
+
+	/* tell readers a message is published; they retry until it is */
+	sequence = mirror->header->sequence;
+	__atomic_store_n(&mirror->header->sequence, 1 + sequence, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	/* make room by dropping the oldest messages, before they are
+	 * overwritten; if the process crashes in the middle, all messages
+	 * between the tail and the head are intact */
+	tail = mirror->header->tail;
+	head = mirror->header->head;
+	while ((MIRROR_SIZE - (head - tail)) < (sizeof(entry_length) + length)) {
+		_copy_out(mirror->data,
+		          tail,
+		          (char *) &entry_length,
+		          sizeof(entry_length));
+		tail += sizeof(entry_length) + entry_length;
+	}
+	__atomic_store_n(&mirror->header->tail, tail, __ATOMIC_RELEASE);
+
+	entry_length = (entry_length_t) length;
+	_copy_in(mirror->data,
+	         head,
+	         (const char *) &entry_length,
+	         sizeof(entry_length),
+	         false);
+	_copy_in(mirror->data, head + sizeof(entry_length), text, length, true);
+	__atomic_store_n(&mirror->header->head,
+	                 head + sizeof(entry_length) + length,
+	                 __ATOMIC_RELEASE);
+
+	__atomic_store_n(&mirror->header->sequence, 2 + sequence, __ATOMIC_RELEASE);
+}
+
+bool mirror_map(mirror_t *mirror, const char *path) {
+	/* the shared file attributes */
+	struct stat attributes = {0};
+
+	assert(NULL != mirror);
+	assert(NULL != path);
+
+	mirror->fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (-1 == mirror->fd) {
+		return false;
+	}
+	if ((-1 == fstat(mirror->fd, &attributes)) ||
+	    (MIRROR_FILE_SIZE != attributes.st_size) ||
+	    (false == _map(mirror, PROT_READ))) {
+		goto close_file;
+	}
+	if (false == _is_valid(mirror->header)) {
+		mirror_close(mirror);
+		return false;
+	}
+
+	return true;
+
+close_file:
+	(void) close(mirror->fd);
+	return false;
+}
+
+bool mirror_copy(const mirror_t *mirror, char *buffer, size_t *size) {
+	/* the sequence number */
+	uint64_t sequence = 0;
+
+	/* the position of the oldest message */
+	uint64_t tail = 0;
+
+	/* the position of the next message */
+	uint64_t head = 0;
+
+	/* the number of attempts */
+	unsigned int attempts = 0;
+
+	assert(NULL != mirror);
+	assert(NULL != buffer);
+	assert(NULL != size);
+
+	/* copy the ring without any system call; if a message was published in
+	 * the meantime, try again, but not forever */
+	for ( ; MIRROR_MAX_ATTEMPTS > attempts; ++attempts) {
+		sequence = __atomic_load_n(&mirror->header->sequence,
+		                           __ATOMIC_ACQUIRE);
+
+		/* if a message is published, wait until it is; if this takes too
+		 * long, the publisher crashed and the ring can be read as it is */
+		if ((0 != (sequence & 1)) && (MIRROR_RETRIES > attempts)) {
+			(void) sched_yield();
+			continue;
+		}
+
+		tail = __atomic_load_n(&mirror->header->tail, __ATOMIC_ACQUIRE);
+		head = __atomic_load_n(&mirror->header->head, __ATOMIC_ACQUIRE);
+		if ((tail > head) || (MIRROR_SIZE < (head - tail))) {
+			(void) sched_yield();
+			continue;
+		}
+		_copy_out(mirror->data, tail, buffer, (size_t) (head - tail));
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (sequence == __atomic_load_n(&mirror->header->sequence,
+		                                __ATOMIC_RELAXED)) {
+			*size = (size_t) (head - tail);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool mirror_next(const char *buffer,
+                 const size_t size,
+                 size_t *offset,
+                 const char **text,
+                 size_t *length) {
+	/* the message length */
+	entry_length_t entry_length = 0;
+
+	assert(NULL != buffer);
+	assert(NULL != offset);
+	assert(NULL != text);
+	assert(NULL != length);
+
+	if (sizeof(entry_length) > (size - *offset)) {
+		return false;
+	}
+
+	/* stop at the first corrupt message */
+	(void) memcpy(&entry_length, &buffer[*offset], sizeof(entry_length));
+	if ((0 == entry_length) ||
+	    (MAX_MESSAGE_LENGTH < entry_length) ||
+	    (entry_length > (size - *offset - sizeof(entry_length)))) {
+		return false;
+	}
+
+	*text = &buffer[*offset + sizeof(entry_length)];
+	*length = (size_t) entry_length;
+	*offset += sizeof(entry_length) + entry_length;
+	return true;
+}
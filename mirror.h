@@ -0,0 +1,55 @@
+#ifndef _MIRROR_H_INCLUDED
+#	define _MIRROR_H_INCLUDED
+
+#	include <stdint.h>
+#	include <stdbool.h>
+#	include <sys/types.h>
+
+#	include "daemon.h"
+
+/* the path of the shared ring of recent messages */
+#	define MIRROR_PATH DAEMON_WORKING_DIRECTORY"/syslogd.ring"
+
+/* the size of the ring of recent messages */
+#	define MIRROR_SIZE (1024 * 1024)
+
+/* the offset of the ring in the shared file, after the header */
+#	define MIRROR_DATA_OFFSET (4096)
+
+/* the shared file header magic */
+#	define MIRROR_MAGIC "SYSLOGR1"
+
+/* the shared file header magic size */
+#	define MIRROR_MAGIC_SIZE (8)
+
+/* the header of the shared file; the sequence number is odd while a message
+ * is published, so readers can tell whether their copy of the ring is
+ * consistent */
+typedef struct {
+	char magic[MIRROR_MAGIC_SIZE];
+	uint64_t size;
+	uint64_t sequence;
+	uint64_t head;
+	uint64_t tail;
+} mirror_header_t;
+
+typedef struct {
+	mirror_header_t *header;
+	char *data;
+	int fd;
+} mirror_t;
+
+bool mirror_open(mirror_t *mirror, const char *path);
+void mirror_close(mirror_t *mirror);
+
+void mirror_publish(mirror_t *mirror, const char *text, const size_t length);
+
+bool mirror_map(mirror_t *mirror, const char *path);
+bool mirror_copy(const mirror_t *mirror, char *buffer, size_t *size);
+bool mirror_next(const char *buffer,
+                 const size_t size,
+                 size_t *offset,
+                 const char **text,
+                 size_t *length);
+
+#endif
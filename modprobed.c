@@ -80,12 +80,19 @@ static bool _load_by_name_or_alias(const char *name_or_alias, void *cache) {
 }
 
 int main(int argc, char *argv[]) {
-	/* a module alias */
-	char alias[1 + MAX_ALIAS_LENGTH] = {'\0'};
+	/* a module alias, preceded by room for the request result */
+	char report[2 + MAX_ALIAS_LENGTH] = {'\0'};
+	char *alias = &report[1];
 
 	/* the Unix socket address */
 	struct sockaddr_un unix_address = {0};
 
+	/* the client address */
+	struct sockaddr_un client_address = {0};
+
+	/* the client address size */
+	socklen_t client_address_size = 0;
+
 	/* the daemon data */
 	daemon_t daemon_data = {{{0}}};
 
@@ -152,12 +159,13 @@ int main(int argc, char *argv[]) {
 		}
 
 		/* receive a module name or alias */
+		client_address_size = sizeof(client_address);
 		size = recvfrom(daemon_data.fd,
 		                alias,
-		                (sizeof(alias) - 1),
+		                (sizeof(report) - 2),
 		                0,
-		                NULL,
-		                NULL);
+		                (struct sockaddr *) &client_address,
+		                &client_address_size);
 		switch (size) {
 			case (-1):
 				if (EAGAIN != errno) {
@@ -167,7 +175,7 @@ int main(int argc, char *argv[]) {
 				/* fall through */
 
 			case 0:
-			case (sizeof(alias) - 1):
+			case (sizeof(report) - 2):
 				continue;
 		}
 
@@ -178,9 +186,21 @@ int main(int argc, char *argv[]) {
 		pid = daemon_fork();
 		switch (pid) {
 			case 0:
+				report[0] = MODPROBED_FAILURE;
 				if (true == _load_by_name_or_alias(alias, &cache)) {
+					report[0] = MODPROBED_SUCCESS;
 					exit_code = EXIT_SUCCESS;
 				}
+
+				/* if the client is bound, report the result */
+				if (sizeof(sa_family_t) < client_address_size) {
+					(void) sendto(daemon_data.fd,
+					              report,
+					              (size_t) (1 + size),
+					              0,
+					              (struct sockaddr *) &client_address,
+					              client_address_size);
+				}
 				goto close_unix;
 
 			case (-1):
@@ -3,4 +3,9 @@
 
 #	define MODPROBED_SOCKET_PATH "/run/modprobed.socket"
 
+/* the first byte of the report sent back to bound clients once a request is
+ * handled, followed by the requested module name or alias */
+#	define MODPROBED_SUCCESS '+'
+#	define MODPROBED_FAILURE '-'
+
 #endif
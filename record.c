@@ -0,0 +1,231 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "codec.h"
+#include "record.h"
+
+/* the CRC-32 polynomial, reversed */
+#define CRC_POLYNOMIAL (0xEDB88320)
+
+/* the CRC-32 lookup table */
+static uint32_t crc_table[256] = {0};
+
+/* fill the lookup table before main() and before any thread is started, so
+ * searching threads only read it */
+__attribute__((constructor))
+static void _fill_crc_table(void) {
+	/* loop indices */
+	unsigned int i = 0;
+	unsigned int j = 0;
+
+	for ( ; ARRAY_SIZE(crc_table) > i; ++i) {
+		crc_table[i] = i;
+		for (j = 0; 8 > j; ++j) {
+			if (0 == (crc_table[i] & 1)) {
+				crc_table[i] >>= 1;
+			} else {
+				crc_table[i] = (crc_table[i] >> 1) ^ CRC_POLYNOMIAL;
+			}
+		}
+	}
+}
+
+static uint32_t _update_crc(uint32_t crc, const void *data, size_t size) {
+	/* the data bytes */
+	const unsigned char *bytes = (const unsigned char *) data;
+
+	for ( ; 0 < size; --size) {
+		crc = crc_table[(crc ^ *bytes) & 0xFF] ^ (crc >> 8);
+		++bytes;
+	}
+
+	return crc;
+}
+
+static uint32_t _get_crc(const record_header_t *header, const char *text) {
+	/* a copy of the header, without the CRC */
+	record_header_t copy = *header;
+
+	copy.crc = 0;
+	return ~_update_crc(_update_crc(~0U, &copy, sizeof(copy)),
+	                    text,
+	                    header->length);
+}
+
+void record_init(record_header_t *header, const message_t *message) {
+	assert(NULL != header);
+	assert(NULL != message);
+
+	(void) memset(header, 0, sizeof(*header));
+	header->length = (uint32_t) message->length;
+	header->realtime = ((int64_t) message->realtime.tv_sec * 1000000000) +
+	                   message->realtime.tv_nsec;
+	header->monotonic = ((int64_t) message->monotonic.tv_sec * 1000000000) +
+	                    message->monotonic.tv_nsec;
+	header->tag_offset = (uint16_t) message->tag_offset;
+	header->tag_length = (uint8_t) message->tag_length;
+	header->facility = (uint8_t) message->facility;
+	header->priority = (uint8_t) message->priority;
+	header->crc = _get_crc(header, message->text);
+}
+
+bool record_is_valid(const record_header_t *header, const char *text) {
+	assert(NULL != header);
+	assert(NULL != text);
+
+	return (_get_crc(header, text) == header->crc);
+}
+
+void record_map_index(const char *path, record_index_t *index) {
+	/* the index path */
+	char index_path[PATH_MAX] = {'\0'};
+
+	/* the index attributes */
+	struct stat attributes = {0};
+
+	/* the index file */
+	int fd = -1;
+
+	assert(NULL != path);
+	assert(NULL != index);
+
+	index->entries = NULL;
+	index->count = 0;
+
+	if (sizeof(index_path) <= snprintf(index_path,
+	                                   sizeof(index_path),
+	                                   RECORD_INDEX_FORMAT,
+	                                   path)) {
+		return;
+	}
+
+	/* map the index; if there is none, it is empty */
+	fd = open(index_path, O_RDONLY);
+	if (-1 == fd) {
+		return;
+	}
+	if ((0 == fstat(fd, &attributes)) &&
+	    (sizeof(index->entries[0]) <= (size_t) attributes.st_size)) {
+		index->entries = mmap(NULL,
+		                      (size_t) attributes.st_size,
+		                      PROT_READ,
+		                      MAP_PRIVATE,
+		                      fd,
+		                      0);
+		if (MAP_FAILED == index->entries) {
+			index->entries = NULL;
+		} else {
+			index->count = (size_t) attributes.st_size /
+			               sizeof(index->entries[0]);
+		}
+	}
+	(void) close(fd);
+}
+
+void record_unmap_index(record_index_t *index) {
+	assert(NULL != index);
+
+	if (NULL != index->entries) {
+		(void) munmap((void *) index->entries,
+		              index->count * sizeof(index->entries[0]));
+	}
+}
+
+size_t record_get_offset(const record_index_t *index,
+                         const size_t i,
+                         const size_t size) {
+	assert(NULL != index);
+	assert(index->count >= i);
+
+	/* if the index entry points outside the segment, start from the first
+	 * record */
+	if ((0 == i) ||
+	    (RECORD_MAGIC_SIZE > index->entries[i - 1].offset) ||
+	    (size <= index->entries[i - 1].offset)) {
+		return RECORD_MAGIC_SIZE;
+	}
+
+	return (size_t) index->entries[i - 1].offset;
+}
+
+size_t record_find(const record_index_t *index,
+                   const size_t size,
+                   const int64_t since) {
+	/* the bounds of the binary search */
+	size_t low = 0;
+	size_t high = index->count;
+	size_t middle = 0;
+
+	assert(NULL != index);
+
+	/* find the last indexed record received before the start of the time
+	 * range */
+	while (low < high) {
+		middle = low + ((high - low) / 2);
+		if (since > index->entries[middle].realtime) {
+			low = 1 + middle;
+		} else {
+			high = middle;
+		}
+	}
+
+	return record_get_offset(index, low, size);
+}
+
+size_t record_find_end(const record_index_t *index,
+                       const size_t size,
+                       const int64_t until) {
+	/* the bounds of the binary search */
+	size_t low = 0;
+	size_t high = index->count;
+	size_t middle = 0;
+
+	assert(NULL != index);
+
+	/* find the first indexed record received after the end of the time
+	 * range; records are written in the order they are received, so the
+	 * range ends before it */
+	while (low < high) {
+		middle = low + ((high - low) / 2);
+		if (until >= index->entries[middle].realtime) {
+			low = 1 + middle;
+		} else {
+			high = middle;
+		}
+	}
+
+	/* if there is no such record, or the index entry points outside the
+	 * segment, the range ends with the segment */
+	if ((index->count == low) ||
+	    (RECORD_MAGIC_SIZE > index->entries[low].offset) ||
+	    (size < index->entries[low].offset)) {
+		return size;
+	}
+
+	return (size_t) index->entries[low].offset;
+}
+
+bool record_read_header(const char *contents,
+                        const size_t size,
+                        const size_t offset,
+                        record_header_t *header) {
+	assert(NULL != contents);
+	assert(NULL != header);
+
+	/* if the record header is incomplete, there are no more records */
+	if ((offset > size) || ((size - offset) <= sizeof(*header))) {
+		return false;
+	}
+
+	/* decode it; if the message is incomplete, stop here too */
+	codec_xor((char *) header, &contents[offset], sizeof(*header));
+	return ((MAX_MESSAGE_LENGTH >= header->length) &&
+	        ((size - offset - sizeof(*header)) >= header->length));
+}
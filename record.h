@@ -0,0 +1,68 @@
+#ifndef _RECORD_H_INCLUDED
+#	define _RECORD_H_INCLUDED
+
+#	include <stdint.h>
+#	include <stdbool.h>
+#	include <sys/types.h>
+
+#	include "message.h"
+
+/* the header of log segments made of records */
+#	define RECORD_MAGIC "LOGREC1\n"
+
+/* the size of the header of log segments made of records */
+#	define RECORD_MAGIC_SIZE (STRLEN(RECORD_MAGIC))
+
+/* the path format of the index of a log segment */
+#	define RECORD_INDEX_FORMAT "%s.idx"
+
+/* the number of records between index entries */
+#	define RECORD_INDEX_INTERVAL (64)
+
+/* a record header, followed by the message text */
+typedef struct {
+	uint32_t length;
+	uint32_t crc;
+	int64_t realtime;
+	int64_t monotonic;
+	uint16_t tag_offset;
+	uint8_t tag_length;
+	uint8_t facility;
+	uint8_t priority;
+	uint8_t reserved[3];
+} record_header_t;
+
+/* an index entry: the offset of the first record received at a given time */
+typedef struct {
+	int64_t realtime;
+	uint64_t offset;
+} record_index_entry_t;
+
+/* a mapped index */
+typedef struct {
+	const record_index_entry_t *entries;
+	size_t count;
+} record_index_t;
+
+void record_init(record_header_t *header, const message_t *message);
+bool record_is_valid(const record_header_t *header, const char *text);
+
+bool record_read_header(const char *contents,
+                        const size_t size,
+                        const size_t offset,
+                        record_header_t *header);
+
+void record_map_index(const char *path, record_index_t *index);
+void record_unmap_index(record_index_t *index);
+
+size_t record_get_offset(const record_index_t *index,
+                         const size_t i,
+                         const size_t size);
+size_t record_find(const record_index_t *index,
+                   const size_t size,
+                   const int64_t since);
+size_t record_find_end(const record_index_t *index,
+                       const size_t size,
+                       const int64_t until);
+
+#endif
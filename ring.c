@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <syslog.h>
+#include <assert.h>
+
+#include "ring.h"
+
+/* the message written after messages were dropped */
+#define DROPPED_MESSAGE "<%d>syslogd: %u messages were dropped"
+
+/* the interval, in nanoseconds, between checks for room in a full ring */
+#define BLOCKING_INTERVAL (1000000)
+
+/* the index mask of messages in the ring */
+#define RING_MASK (RING_SIZE - 1)
+
+bool ring_init(ring_t *ring, const bool is_blocking) {
+	/* the condition variable attributes */
+	pthread_condattr_t attributes;
+
+	assert(NULL != ring);
+
+	ring->head = 0;
+	ring->tail = 0;
+	ring->dropped = 0;
+	ring->notifications = 0;
+	ring->is_blocking = is_blocking;
+	ring->is_closed = false;
+
+	/* wait for messages using the monotonic clock, so deadlines do not move
+	 * when the wall clock is set */
+	if (0 != pthread_condattr_init(&attributes)) {
+		return false;
+	}
+	if ((0 != pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC)) ||
+	    (0 != pthread_cond_init(&ring->cond, &attributes))) {
+		goto destroy_attributes;
+	}
+	if (0 != pthread_mutex_init(&ring->mutex, NULL)) {
+		goto destroy_cond;
+	}
+	(void) pthread_condattr_destroy(&attributes);
+
+	return true;
+
+destroy_cond:
+	(void) pthread_cond_destroy(&ring->cond);
+
+destroy_attributes:
+	(void) pthread_condattr_destroy(&attributes);
+	return false;
+}
+
+void ring_destroy(ring_t *ring) {
+	assert(NULL != ring);
+
+	(void) pthread_mutex_destroy(&ring->mutex);
+	(void) pthread_cond_destroy(&ring->cond);
+}
+
+static bool _has_room(const int priority, const size_t used) {
+	/* keep room for messages of higher priority: the lower the priority of a
+	 * message, the emptier the ring must be; LOG_DEBUG messages are dropped
+	 * once the ring is about half full */
+	return ((RING_SIZE - ((size_t) priority * (RING_SIZE / 16))) > used);
+}
+
+bool ring_push(ring_t *ring,
+               const char *text,
+               const size_t length,
+               const char *label,
+               const size_t label_length) {
+	/* the interval between checks for room in a full ring */
+	static const struct timespec interval = {0, BLOCKING_INTERVAL};
+
+	/* the message */
+	message_t *message = NULL;
+
+	/* a report of dropped messages */
+	char report[64] = {'\0'};
+
+	/* the number of messages in the ring */
+	size_t used = 0;
+
+	assert(NULL != ring);
+	assert(NULL != text);
+
+	/* if the ring is full, either wait until there is room or drop the
+	 * message */
+	do {
+		used = ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+		if (RING_SIZE > used) {
+			break;
+		}
+		if (false == ring->is_blocking) {
+			++ring->dropped;
+			return false;
+		}
+		(void) nanosleep(&interval, NULL);
+	} while (1);
+
+	/* parse the message, in the next free slot */
+	message = &ring->messages[ring->head & RING_MASK];
+	message_init(message, text, length);
+	if (NULL != label) {
+		message_label(message, label, label_length);
+	}
+
+	/* if the ring is too full for a message of this priority, drop it */
+	if ((false == ring->is_blocking) &&
+	    (false == _has_room(message->priority, used))) {
+		++ring->dropped;
+		return false;
+	}
+
+	/* publish the message */
+	__atomic_store_n(&ring->head, 1 + ring->head, __ATOMIC_RELEASE);
+	++used;
+
+	/* if messages were dropped and the ring is no longer crowded, report
+	 * that */
+	if ((0 < ring->dropped) && ((RING_SIZE / 2) > used)) {
+		message = &ring->messages[ring->head & RING_MASK];
+		message_init(message,
+		             report,
+		             (size_t) snprintf(report,
+		                               sizeof(report),
+		                               DROPPED_MESSAGE,
+		                               LOG_SYSLOG | LOG_WARNING,
+		                               ring->dropped));
+		__atomic_store_n(&ring->head, 1 + ring->head, __ATOMIC_RELEASE);
+		ring->dropped = 0;
+	}
+
+	return true;
+}
+
+void ring_notify(ring_t *ring) {
+	assert(NULL != ring);
+
+	(void) pthread_mutex_lock(&ring->mutex);
+	++ring->notifications;
+	(void) pthread_cond_signal(&ring->cond);
+	(void) pthread_mutex_unlock(&ring->mutex);
+}
+
+void ring_close(ring_t *ring) {
+	assert(NULL != ring);
+
+	__atomic_store_n(&ring->is_closed, true, __ATOMIC_RELEASE);
+	ring_notify(ring);
+}
+
+message_t *ring_peek(ring_t *ring) {
+	assert(NULL != ring);
+
+	if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail) {
+		return NULL;
+	}
+
+	return &ring->messages[ring->tail & RING_MASK];
+}
+
+void ring_pop(ring_t *ring) {
+	assert(NULL != ring);
+
+	__atomic_store_n(&ring->tail, 1 + ring->tail, __ATOMIC_RELEASE);
+}
+
+bool ring_wait(ring_t *ring, const struct timespec *timeout) {
+	/* the time the wait ends at */
+	struct timespec deadline = {0};
+
+	/* the wait result */
+	int result = 0;
+
+	assert(NULL != ring);
+
+	/* the condition variable expects an absolute, monotonic time */
+	if (NULL != timeout) {
+		if (-1 == clock_gettime(CLOCK_MONOTONIC, &deadline)) {
+			return false;
+		}
+		deadline.tv_sec += timeout->tv_sec;
+		deadline.tv_nsec += timeout->tv_nsec;
+		if (1000000000L <= deadline.tv_nsec) {
+			++deadline.tv_sec;
+			deadline.tv_nsec -= 1000000000L;
+		}
+	}
+
+	/* wait until messages are pushed or, if there is a timeout, until it
+	 * passes */
+	(void) pthread_mutex_lock(&ring->mutex);
+	while ((0 == ring->notifications) && (0 == result)) {
+		if (NULL == timeout) {
+			result = pthread_cond_wait(&ring->cond, &ring->mutex);
+		} else {
+			result = pthread_cond_timedwait(&ring->cond,
+			                                &ring->mutex,
+			                                &deadline);
+		}
+	}
+	if (0 < ring->notifications) {
+		--ring->notifications;
+		result = 0;
+	}
+	(void) pthread_mutex_unlock(&ring->mutex);
+
+	return (0 == result);
+}
+
+bool ring_is_closed(ring_t *ring) {
+	assert(NULL != ring);
+
+	return __atomic_load_n(&ring->is_closed, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,41 @@
+#ifndef _RING_H_INCLUDED
+#	define _RING_H_INCLUDED
+
+#	include <stdbool.h>
+#	include <pthread.h>
+#	include <time.h>
+
+#	include "message.h"
+
+/* the number of messages in the ring; must be a power of 2 */
+#	define RING_SIZE (1024)
+
+typedef struct {
+	message_t messages[RING_SIZE];
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	unsigned int notifications;
+	size_t head;
+	size_t tail;
+	unsigned int dropped;
+	bool is_blocking;
+	bool is_closed;
+} ring_t;
+
+bool ring_init(ring_t *ring, const bool is_blocking);
+void ring_destroy(ring_t *ring);
+
+bool ring_push(ring_t *ring,
+               const char *text,
+               const size_t length,
+               const char *label,
+               const size_t label_length);
+void ring_notify(ring_t *ring);
+void ring_close(ring_t *ring);
+
+message_t *ring_peek(ring_t *ring);
+void ring_pop(ring_t *ring);
+bool ring_wait(ring_t *ring, const struct timespec *timeout);
+bool ring_is_closed(ring_t *ring);
+
+#endif
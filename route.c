@@ -0,0 +1,350 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "common.h"
+#include "route.h"
+
+/* the separators between the selector and the path of a rule */
+#define SEPARATORS " \t"
+
+/* a wildcard, which matches any facility or priority */
+#define WILDCARD "*"
+
+typedef struct {
+	const char *name;
+	int value;
+} name_t;
+
+static const name_t g_facilities[] = {
+	{"kern", LOG_FAC(LOG_KERN)},
+	{"user", LOG_FAC(LOG_USER)},
+	{"mail", LOG_FAC(LOG_MAIL)},
+	{"daemon", LOG_FAC(LOG_DAEMON)},
+	{"auth", LOG_FAC(LOG_AUTH)},
+	{"syslog", LOG_FAC(LOG_SYSLOG)},
+	{"lpr", LOG_FAC(LOG_LPR)},
+	{"news", LOG_FAC(LOG_NEWS)},
+	{"uucp", LOG_FAC(LOG_UUCP)},
+	{"cron", LOG_FAC(LOG_CRON)},
+	{"authpriv", LOG_FAC(LOG_AUTHPRIV)},
+	{"ftp", LOG_FAC(LOG_FTP)},
+	{"local0", LOG_FAC(LOG_LOCAL0)},
+	{"local1", LOG_FAC(LOG_LOCAL1)},
+	{"local2", LOG_FAC(LOG_LOCAL2)},
+	{"local3", LOG_FAC(LOG_LOCAL3)},
+	{"local4", LOG_FAC(LOG_LOCAL4)},
+	{"local5", LOG_FAC(LOG_LOCAL5)},
+	{"local6", LOG_FAC(LOG_LOCAL6)},
+	{"local7", LOG_FAC(LOG_LOCAL7)}
+};
+
+static const name_t g_priorities[] = {
+	{"emerg", LOG_EMERG},
+	{"alert", LOG_ALERT},
+	{"crit", LOG_CRIT},
+	{"err", LOG_ERR},
+	{"warning", LOG_WARNING},
+	{"notice", LOG_NOTICE},
+	{"info", LOG_INFO},
+	{"debug", LOG_DEBUG}
+};
+
+static bool _parse_name(const name_t *names,
+                        const unsigned int count,
+                        const char *name,
+                        int *value) {
+	/* a loop index */
+	unsigned int i = 0;
+
+	assert(NULL != names);
+	assert(NULL != name);
+	assert(NULL != value);
+
+	for ( ; count > i; ++i) {
+		if (0 == strcmp(names[i].name, name)) {
+			*value = names[i].value;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool _add_destination(router_t *router,
+                             const char *path,
+                             unsigned char *destination) {
+	/* a loop index */
+	unsigned int i = 0;
+
+	assert(NULL != router);
+	assert(NULL != path);
+	assert(NULL != destination);
+
+	/* rules with the same path share a destination */
+	for ( ; router->destinations > i; ++i) {
+		if (0 == strcmp(router->paths[i], path)) {
+			*destination = (unsigned char) i;
+			return true;
+		}
+	}
+
+	if (MAX_DESTINATIONS == router->destinations) {
+		return false;
+	}
+	router->paths[i] = strdup(path);
+	if (NULL == router->paths[i]) {
+		return false;
+	}
+	++router->destinations;
+	*destination = (unsigned char) i;
+
+	return true;
+}
+
+static bool _parse_rule(router_t *router, char *line) {
+	/* the rule */
+	route_rule_t *rule = NULL;
+
+	/* the rule selector */
+	char *selector = NULL;
+
+	/* the rule priority */
+	char *priority = NULL;
+
+	/* the rule tag */
+	char *tag = NULL;
+
+	/* the rule path */
+	char *path = NULL;
+
+	/* the parsing position */
+	char *position = NULL;
+
+	assert(NULL != router);
+	assert(NULL != line);
+
+	if (MAX_RULES == router->count) {
+		return false;
+	}
+	rule = &router->rules[router->count];
+	rule->tag_length = 0;
+
+	/* split the rule into a selector and a path, which must be absolute */
+	selector = strtok_r(line, SEPARATORS, &position);
+	if (NULL == selector) {
+		return false;
+	}
+	path = strtok_r(NULL, SEPARATORS, &position);
+	if ((NULL == path) ||
+	    ('/' != path[0]) ||
+	    (NULL != strtok_r(NULL, SEPARATORS, &position))) {
+		return false;
+	}
+
+	/* split the selector into a facility, a priority and an optional tag */
+	priority = strchr(selector, '.');
+	if (NULL == priority) {
+		return false;
+	}
+	*priority = '\0';
+	++priority;
+	tag = strchr(priority, ':');
+	if (NULL != tag) {
+		*tag = '\0';
+		++tag;
+		rule->tag_length = strlen(tag);
+		if ((0 == rule->tag_length) || (MAX_TAG_LENGTH < rule->tag_length)) {
+			return false;
+		}
+		(void) memcpy(rule->tag, tag, rule->tag_length);
+	}
+
+	if (0 == strcmp(WILDCARD, selector)) {
+		rule->facility = -1;
+	} else {
+		if (false == _parse_name(g_facilities,
+		                         ARRAY_SIZE(g_facilities),
+		                         selector,
+		                         &rule->facility)) {
+			return false;
+		}
+	}
+
+	if (0 == strcmp(WILDCARD, priority)) {
+		rule->priority = LOG_DEBUG;
+	} else {
+		if (false == _parse_name(g_priorities,
+		                         ARRAY_SIZE(g_priorities),
+		                         priority,
+		                         &rule->priority)) {
+			return false;
+		}
+	}
+
+	if (false == _add_destination(router, path, &rule->destination)) {
+		return false;
+	}
+	++router->count;
+
+	return true;
+}
+
+static bool _matches(const route_rule_t *rule,
+                     const int facility,
+                     const int priority) {
+	assert(NULL != rule);
+
+	/* a rule matches its priority and all more severe ones */
+	return (((-1 == rule->facility) || (facility == rule->facility)) &&
+	        (rule->priority >= priority));
+}
+
+static void _compile(router_t *router) {
+	/* the rule */
+	const route_rule_t *rule = NULL;
+
+	/* a loop index */
+	unsigned int i = 0;
+
+	/* the facility */
+	int facility = 0;
+
+	/* the priority */
+	int priority = 0;
+
+	assert(NULL != router);
+
+	/* for each facility and priority, find the first matching rule; if it
+	 * matches only some tags, the rules are matched against each message */
+	for ( ; ROUTE_FACILITIES > facility; ++facility) {
+		for (priority = 0; ROUTE_PRIORITIES > priority; ++priority) {
+			router->table[facility][priority] = ROUTE_DEFAULT;
+			for (i = 0; router->count > i; ++i) {
+				rule = &router->rules[i];
+				if (false == _matches(rule, facility, priority)) {
+					continue;
+				}
+				if (0 == rule->tag_length) {
+					router->table[facility][priority] = rule->destination;
+				} else {
+					router->table[facility][priority] = ROUTE_BY_TAG;
+				}
+				break;
+			}
+		}
+	}
+}
+
+bool router_load(router_t *router, const char *path) {
+	/* a line in the rules file */
+	char line[1 + MAX_LENGTH] = {'\0'};
+
+	/* the rules file */
+	FILE *file = NULL;
+
+	/* the line length */
+	size_t length = 0;
+
+	/* the unused default destination */
+	unsigned char destination = ROUTE_DEFAULT;
+
+	assert(NULL != router);
+	assert(NULL != path);
+
+	router->count = 0;
+	router->destinations = 0;
+
+	/* messages no rule matches are written to the system log */
+	if (false == _add_destination(router, LOG_FILE_PATH, &destination)) {
+		return false;
+	}
+
+	/* open the rules file; if it does not exist, all messages are written to
+	 * the system log */
+	file = fopen(path, "r");
+	if (NULL == file) {
+		if (ENOENT != errno) {
+			goto free_router;
+		}
+		goto compile;
+	}
+
+	while (NULL != fgets(line, sizeof(line), file)) {
+		/* strip the line break */
+		length = strlen(line);
+		if ((0 < length) && ('\n' == line[length - 1])) {
+			line[length - 1] = '\0';
+		}
+
+		/* skip empty lines and comments */
+		if (('\0' == line[0]) || ('#' == line[0])) {
+			continue;
+		}
+
+		if (false == _parse_rule(router, line)) {
+			(void) fclose(file);
+			goto free_router;
+		}
+	}
+
+	(void) fclose(file);
+
+compile:
+	_compile(router);
+	return true;
+
+free_router:
+	router_free(router);
+	return false;
+}
+
+void router_free(router_t *router) {
+	/* a loop index */
+	unsigned int i = 0;
+
+	assert(NULL != router);
+
+	for ( ; router->destinations > i; ++i) {
+		free(router->paths[i]);
+	}
+	router->destinations = 0;
+	router->count = 0;
+}
+
+unsigned int router_route(const router_t *router, const message_t *message) {
+	/* a rule */
+	const route_rule_t *rule = NULL;
+
+	/* a loop index */
+	unsigned int i = 0;
+
+	/* the destination */
+	unsigned char destination = ROUTE_DEFAULT;
+
+	assert(NULL != router);
+	assert(NULL != message);
+
+	/* usually, the destination depends only on the facility and priority */
+	destination = router->table[message->facility][message->priority];
+	if (ROUTE_BY_TAG != destination) {
+		return destination;
+	}
+
+	/* otherwise, find the first rule which matches the tag as well */
+	for ( ; router->count > i; ++i) {
+		rule = &router->rules[i];
+		if ((true == _matches(rule, message->facility, message->priority)) &&
+		    ((0 == rule->tag_length) ||
+		     ((rule->tag_length == message->tag_length) &&
+		      (0 == memcmp(rule->tag,
+		                   &message->text[message->tag_offset],
+		                   rule->tag_length))))) {
+			return rule->destination;
+		}
+	}
+
+	return ROUTE_DEFAULT;
+}
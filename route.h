@@ -0,0 +1,50 @@
+#ifndef _ROUTE_H_INCLUDED
+#	define _ROUTE_H_INCLUDED
+
+#	include <stdbool.h>
+#	include <syslog.h>
+
+#	include "message.h"
+
+/* the routing rules path */
+#	define ROUTES_PATH CONF_DIR"/syslogd.conf"
+
+/* the maximum number of destinations, including the system log */
+#	define MAX_DESTINATIONS (8)
+
+/* the maximum number of routing rules */
+#	define MAX_RULES (32)
+
+/* the numbers of facilities and priorities */
+#	define ROUTE_FACILITIES (1 + LOG_FAC(LOG_LOCAL7))
+#	define ROUTE_PRIORITIES (1 + LOG_DEBUG)
+
+/* a lookup table value which means that rules must be matched against the
+ * message tag */
+#	define ROUTE_BY_TAG (0xFF)
+
+/* the destination of messages no rule matches */
+#	define ROUTE_DEFAULT (0)
+
+typedef struct {
+	char tag[1 + MAX_TAG_LENGTH];
+	size_t tag_length;
+	int facility;
+	int priority;
+	unsigned char destination;
+} route_rule_t;
+
+typedef struct {
+	route_rule_t rules[MAX_RULES];
+	char *paths[MAX_DESTINATIONS];
+	unsigned int count;
+	unsigned int destinations;
+	unsigned char table[ROUTE_FACILITIES][ROUTE_PRIORITIES];
+} router_t;
+
+bool router_load(router_t *router, const char *path);
+void router_free(router_t *router);
+
+unsigned int router_route(const router_t *router, const message_t *message);
+
+#endif
@@ -0,0 +1,521 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <regex.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "syslog.h"
+#include "codec.h"
+#include "message.h"
+#include "record.h"
+#include "search.h"
+
+/* the number of parts of a log segment searched but not displayed yet, per
+ * thread */
+#define PENDING_JOBS (4)
+
+/* the initial size of the matching messages buffer of a job */
+#define MIN_OUTPUT_SIZE (4096)
+
+typedef struct {
+	char *output;
+	size_t length;
+	size_t size;
+	size_t start;
+	size_t end;
+	bool is_done;
+	bool is_failed;
+} job_t;
+
+typedef struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	const char *contents;
+	const filter_t *filter;
+	job_t *jobs;
+	size_t size;
+	size_t count;
+	size_t next;
+	size_t displayed;
+	size_t window;
+	bool is_binary;
+	bool is_cancelled;
+} search_t;
+
+static bool _append(job_t *job, const char *line, const size_t length) {
+	/* the resized buffer */
+	char *output = NULL;
+
+	/* the new buffer size */
+	size_t size = 0;
+
+	/* make room for the line and a line break */
+	if ((job->size - job->length) <= length) {
+		size = (0 == job->size) ? MIN_OUTPUT_SIZE : job->size;
+		while ((size - job->length) <= length) {
+			size *= 2;
+		}
+		output = realloc(job->output, size);
+		if (NULL == output) {
+			return false;
+		}
+		job->output = output;
+		job->size = size;
+	}
+
+	(void) memcpy(&job->output[job->length], line, length);
+	job->length += length;
+
+	/* make sure the line ends with a line break */
+	if ((0 == length) || ('\n' != line[length - 1])) {
+		job->output[job->length] = '\n';
+		++job->length;
+	}
+
+	return true;
+}
+
+static bool _matches(const filter_t *filter,
+                     const regex_t *regex,
+                     const char *line,
+                     const size_t length,
+                     const size_t tag_offset,
+                     const size_t tag_length) {
+	/* the line, terminated */
+	char buffer[1 + MAX_MESSAGE_LENGTH] = {'\0'};
+
+	/* the line length, without its line break */
+	size_t size = length;
+
+	if ((NULL != filter->tag) &&
+	    ((strlen(filter->tag) != tag_length) ||
+	     (0 != memcmp(&line[tag_offset], filter->tag, tag_length)))) {
+		return false;
+	}
+
+	if (NULL == filter->pattern) {
+		return true;
+	}
+
+	/* match the pattern against the line, without its line break */
+	if ((0 < size) && ('\n' == line[size - 1])) {
+		--size;
+	}
+
+	if (NULL != regex) {
+		/* the line is not terminated, so copy it; REG_STARTEND is not
+		 * portable */
+		if (MAX_MESSAGE_LENGTH < size) {
+			size = MAX_MESSAGE_LENGTH;
+		}
+		(void) memcpy(buffer, line, size);
+		buffer[size] = '\0';
+		return (0 == regexec(regex, buffer, 0, NULL, 0));
+	}
+
+	return (NULL != memmem(line,
+	                       size,
+	                       filter->pattern,
+	                       strlen(filter->pattern)));
+}
+
+static bool _search_lines(const search_t *search,
+                          job_t *job,
+                          const regex_t *regex) {
+	/* the decoded part of the segment */
+	char *lines = NULL;
+
+	/* the end of the current line */
+	char *end = NULL;
+
+	/* the size of the decoded part */
+	size_t size = job->end - job->start;
+
+	/* the offset of the current line */
+	size_t offset = 0;
+
+	/* the length of the current line */
+	size_t length = 0;
+
+	/* the position of the tag in the current line */
+	size_t tag_offset = 0;
+	size_t tag_length = 0;
+
+	/* the return value */
+	bool result = false;
+
+	/* the facility and priority of a line */
+	int facility = 0;
+	int priority = 0;
+
+	if (0 == size) {
+		return true;
+	}
+
+	/* decode the whole part at once */
+	lines = malloc(size);
+	if (NULL == lines) {
+		goto end;
+	}
+	codec_xor(lines, &search->contents[job->start], size);
+
+	for ( ; size > offset; offset += length) {
+		end = memchr(&lines[offset], '\n', size - offset);
+		if (NULL == end) {
+			length = size - offset;
+		} else {
+			length = 1 + (size_t) (end - &lines[offset]);
+		}
+
+		tag_offset = message_parse_priority(&lines[offset],
+		                                    length,
+		                                    &facility,
+		                                    &priority);
+		if (search->filter->priority < priority) {
+			continue;
+		}
+		if (NULL != search->filter->tag) {
+			message_parse_tag(&lines[offset],
+			                  length,
+			                  tag_offset,
+			                  &tag_offset,
+			                  &tag_length);
+		}
+
+		if ((true == _matches(search->filter,
+		                      regex,
+		                      &lines[offset],
+		                      length,
+		                      tag_offset,
+		                      tag_length)) &&
+		    (false == _append(job, &lines[offset], length))) {
+			goto free_lines;
+		}
+	}
+
+	result = true;
+
+free_lines:
+	free(lines);
+
+end:
+	return result;
+}
+
+static bool _search_records(const search_t *search,
+                            job_t *job,
+                            const regex_t *regex) {
+	/* a message */
+	char text[1 + MAX_MESSAGE_LENGTH] = {'\0'};
+
+	/* a record header */
+	record_header_t header = {0};
+
+	/* the offset of the current record */
+	size_t offset = job->start;
+
+	for ( ;
+	     (job->end > offset) &&
+	     (true == record_read_header(search->contents,
+	                                 search->size,
+	                                 offset,
+	                                 &header));
+	     offset += sizeof(header) + header.length) {
+		/* skip records without decoding their messages; the time range
+		 * is checked for each record, not only where it ends, since the
+		 * clock may have been set back while they were written */
+		if ((search->filter->since > header.realtime) ||
+		    (search->filter->until < header.realtime) ||
+		    (search->filter->priority < header.priority) ||
+		    (header.length < (header.tag_offset + header.tag_length))) {
+			continue;
+		}
+
+		/* skip corrupt records */
+		codec_xor(text,
+		          &search->contents[offset + sizeof(header)],
+		          header.length);
+		if (false == record_is_valid(&header, text)) {
+			continue;
+		}
+
+		if ((true == _matches(search->filter,
+		                      regex,
+		                      text,
+		                      header.length,
+		                      header.tag_offset,
+		                      header.tag_length)) &&
+		    (false == _append(job, text, header.length))) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void *_search(void *arg) {
+	/* the search state */
+	search_t *search = (search_t *) arg;
+
+	/* the regular expression, compiled for this thread, since regexec()
+	 * serializes calls with the same one */
+	regex_t regex = {0};
+
+	/* the regular expression, if there is one */
+	const regex_t *compiled = NULL;
+
+	/* the current job */
+	job_t *job = NULL;
+
+	/* a flag which indicates whether the job succeeded */
+	bool is_successful = false;
+
+	/* a flag which indicates whether the filter can be applied */
+	bool is_valid = true;
+
+	assert(NULL != search);
+
+	if ((NULL != search->filter->pattern) &&
+	    (true == search->filter->is_regex)) {
+		if (0 == regcomp(&regex,
+		                 search->filter->pattern,
+		                 REG_EXTENDED | REG_NOSUB)) {
+			compiled = &regex;
+		} else {
+			is_valid = false;
+		}
+	}
+
+	do {
+		/* take the next job, unless too many were not displayed yet */
+		(void) pthread_mutex_lock(&search->mutex);
+		while ((false == search->is_cancelled) &&
+		       (search->count > search->next) &&
+		       ((search->displayed + search->window) <= search->next)) {
+			(void) pthread_cond_wait(&search->cond, &search->mutex);
+		}
+		if ((true == search->is_cancelled) ||
+		    (search->count == search->next)) {
+			(void) pthread_mutex_unlock(&search->mutex);
+			break;
+		}
+		job = &search->jobs[search->next];
+		++search->next;
+		(void) pthread_mutex_unlock(&search->mutex);
+
+		if (false == is_valid) {
+			is_successful = false;
+		} else if (true == search->is_binary) {
+			is_successful = _search_records(search, job, compiled);
+		} else {
+			is_successful = _search_lines(search, job, compiled);
+		}
+
+		/* pass the matching messages to the displaying thread */
+		(void) pthread_mutex_lock(&search->mutex);
+		job->is_failed = (false == is_successful);
+		job->is_done = true;
+		(void) pthread_cond_broadcast(&search->cond);
+		(void) pthread_mutex_unlock(&search->mutex);
+	} while (1);
+
+	if (NULL != compiled) {
+		regfree(&regex);
+	}
+
+	return NULL;
+}
+
+static size_t _split_lines(const char *contents,
+                           const size_t size,
+                           job_t *jobs) {
+	/* a line break, once encoded */
+	const char encoded_line_break = (char) ('\n' ^ XOR_KEY);
+
+	/* the line break before a part */
+	const char *line_break = NULL;
+
+	/* the number of parts */
+	size_t count = 0;
+
+	/* the start of the current part */
+	size_t start = 0;
+
+	/* split the segment into parts which begin after a line break, without
+	 * decoding it */
+	for (count = 0; size > start; ++count) {
+		jobs[count].start = start;
+		start += SEARCH_CHUNK_SIZE;
+		if (size <= start) {
+			start = size;
+		} else {
+			line_break = memchr(&contents[start - 1],
+			                    encoded_line_break,
+			                    size - (start - 1));
+			if (NULL == line_break) {
+				start = size;
+			} else {
+				start = 1 + (size_t) (line_break - contents);
+			}
+		}
+		jobs[count].end = start;
+	}
+
+	return count;
+}
+
+static size_t _split_records(const char *path,
+                             const size_t size,
+                             const int64_t since,
+                             job_t *jobs) {
+	/* the segment index */
+	record_index_t index = {0};
+
+	/* the number of parts */
+	size_t count = 0;
+
+	/* the start of the current part */
+	size_t start = 0;
+
+	/* a loop index */
+	size_t i = 0;
+
+	/* start from the last indexed record before the time range */
+	record_map_index(path, &index);
+	if (INT64_MIN == since) {
+		start = RECORD_MAGIC_SIZE;
+	} else {
+		start = record_find(&index, size, since);
+	}
+
+	/* split the rest of the segment into parts which begin with indexed
+	 * records */
+	jobs[0].start = start;
+	for (i = 1; index.count >= i; ++i) {
+		if ((start + SEARCH_CHUNK_SIZE) > record_get_offset(&index, i, size)) {
+			continue;
+		}
+		start = record_get_offset(&index, i, size);
+		jobs[count].end = start;
+		++count;
+		jobs[count].start = start;
+	}
+	jobs[count].end = size;
+
+	record_unmap_index(&index);
+	return 1 + count;
+}
+
+bool search_segment(const char *contents,
+                    const size_t size,
+                    const char *path,
+                    const bool is_binary,
+                    const filter_t *filter) {
+	/* the searching threads */
+	pthread_t threads[MAX_SEARCH_THREADS] = {0};
+
+	/* a job */
+	job_t *job = NULL;
+
+	/* the search state */
+	search_t search = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+	/* the number of searching threads */
+	long processors = 0;
+
+	/* the number of started threads */
+	size_t started = 0;
+
+	/* a loop index */
+	size_t i = 0;
+
+	/* the return value */
+	bool result = false;
+
+	assert(NULL != contents);
+	assert(NULL != path);
+	assert(NULL != filter);
+
+	search.contents = contents;
+	search.size = size;
+	search.filter = filter;
+	search.is_binary = is_binary;
+
+	/* split the segment into parts */
+	search.jobs = calloc(1 + (size / SEARCH_CHUNK_SIZE), sizeof(job_t));
+	if (NULL == search.jobs) {
+		goto end;
+	}
+	if (true == is_binary) {
+		search.count = _split_records(path, size, filter->since, search.jobs);
+	} else {
+		search.count = _split_lines(contents, size, search.jobs);
+	}
+
+	/* search them using all processors */
+	processors = sysconf(_SC_NPROCESSORS_ONLN);
+	if (1 > processors) {
+		processors = 1;
+	} else if (MAX_SEARCH_THREADS < processors) {
+		processors = MAX_SEARCH_THREADS;
+	}
+	if (search.count < (size_t) processors) {
+		processors = (long) search.count;
+	}
+	search.window = PENDING_JOBS * (size_t) processors;
+	for ( ; (size_t) processors > started; ++started) {
+		if (0 != pthread_create(&threads[started], NULL, _search, &search)) {
+			break;
+		}
+	}
+	if ((0 == started) && (0 < search.count)) {
+		goto free_jobs;
+	}
+
+	/* display the matching messages of each part, in order */
+	for (i = 0; search.count > i; ++i) {
+		(void) pthread_mutex_lock(&search.mutex);
+		while (false == search.jobs[i].is_done) {
+			(void) pthread_cond_wait(&search.cond, &search.mutex);
+		}
+		(void) pthread_mutex_unlock(&search.mutex);
+
+		job = &search.jobs[i];
+		if ((true == job->is_failed) ||
+		    ((0 < job->length) &&
+		     ((ssize_t) job->length != write(STDOUT_FILENO,
+		                                     job->output,
+		                                     job->length)))) {
+			break;
+		}
+		free(job->output);
+		job->output = NULL;
+
+		(void) pthread_mutex_lock(&search.mutex);
+		++search.displayed;
+		(void) pthread_cond_broadcast(&search.cond);
+		(void) pthread_mutex_unlock(&search.mutex);
+	}
+	if (search.count == i) {
+		result = true;
+	}
+
+	/* if displaying failed, stop all threads */
+	(void) pthread_mutex_lock(&search.mutex);
+	search.is_cancelled = true;
+	(void) pthread_cond_broadcast(&search.cond);
+	(void) pthread_mutex_unlock(&search.mutex);
+	for (i = 0; started > i; ++i) {
+		(void) pthread_join(threads[i], NULL);
+	}
+
+free_jobs:
+	for (i = 0; search.count > i; ++i) {
+		free(search.jobs[i].output);
+	}
+	free(search.jobs);
+
+end:
+	return result;
+}
@@ -0,0 +1,30 @@
+#ifndef _SEARCH_H_INCLUDED
+#	define _SEARCH_H_INCLUDED
+
+#	include <stdbool.h>
+#	include <stdint.h>
+#	include <sys/types.h>
+
+/* the size of the parts of log segments searched concurrently */
+#	define SEARCH_CHUNK_SIZE (1024 * 1024)
+
+/* the maximum number of threads searching a log segment */
+#	define MAX_SEARCH_THREADS (64)
+
+typedef struct {
+	const char *pattern;
+	const char *tag;
+	int64_t since;
+	int64_t until;
+	int priority;
+	bool is_regex;
+	bool is_filtered;
+} filter_t;
+
+bool search_segment(const char *contents,
+                    const size_t size,
+                    const char *path,
+                    const bool is_binary,
+                    const filter_t *filter);
+
+#endif
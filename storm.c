@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include <assert.h>
+
+#include "common.h"
+#include "storm.h"
+
+/* the report of suppressed messages */
+#define REPORT_FORMAT "suppressed %u similar messages: %s"
+
+/* the 64-bit FNV-1a offset basis and prime; the hash is wide enough to tell
+ * groups apart without comparing their messages */
+#define FNV_OFFSET_BASIS (UINT64_C(14695981039346656037))
+#define FNV_PRIME (UINT64_C(1099511628211))
+
+/* the character numbers are replaced with, when messages are compared */
+#define NUMBER_MASK '#'
+
+/* the number of similar messages of each priority passed in each window;
+ * messages of priority 0 (the highest) to 2 are never suppressed */
+static const unsigned int g_thresholds[] = {0, 0, 0, 20, 10, 5, 5, 5};
+
+static bool _is_digit(const char c) {
+	return (('0' <= c) && ('9' >= c));
+}
+
+static bool _is_number(const char c) {
+	/* numbers may be hexadecimal, e.g addresses */
+	return ((true == _is_digit(c)) ||
+	        (('a' <= c) && ('f' >= c)) ||
+	        (('A' <= c) && ('F' >= c)) ||
+	        ('x' == c));
+}
+
+static uint64_t _hash(const char *text, const size_t length) {
+	/* the hash */
+	uint64_t hash = FNV_OFFSET_BASIS;
+
+	/* a loop index */
+	size_t i = 0;
+
+	/* hash the text with each number replaced by the same character, so
+	 * messages which differ only in numbers (e.g counters, addresses or
+	 * device numbers) are similar */
+	while (length > i) {
+		if (true == _is_digit(text[i])) {
+			hash = (hash ^ (unsigned char) NUMBER_MASK) * FNV_PRIME;
+			for (++i; (length > i) && (true == _is_number(text[i])); ++i);
+			continue;
+		}
+		hash = (hash ^ (unsigned char) text[i]) * FNV_PRIME;
+		++i;
+	}
+
+	return hash;
+}
+
+static void _report(storm_group_t *group,
+                    const uint64_t now,
+                    kmsg_record_t *report) {
+	/* the report length */
+	int length = 0;
+
+	assert(NULL != group);
+	assert(NULL != report);
+
+	/* report the suppressed messages with their facility and priority, and
+	 * a sample of them */
+	length = snprintf(report->text,
+	                  sizeof(report->text),
+	                  REPORT_FORMAT,
+	                  group->suppressed,
+	                  group->sample);
+	report->length = (size_t) length;
+	if (sizeof(report->text) <= report->length) {
+		report->length = sizeof(report->text) - 1;
+	}
+	report->facility = group->facility;
+	report->priority = group->priority;
+	report->timestamp = now * 1000;
+
+	group->suppressed = 0;
+}
+
+void storm_init(storm_t *storm) {
+	/* a loop index */
+	unsigned int i = 0;
+
+	assert(NULL != storm);
+
+	for ( ; STORM_GROUPS > i; ++i) {
+		storm->groups[i].is_used = false;
+		storm->groups[i].suppressed = 0;
+	}
+}
+
+bool storm_is_suppressed(storm_t *storm,
+                         const kmsg_record_t *record,
+                         kmsg_record_t *report,
+                         bool *is_reported) {
+	/* the group of similar messages */
+	storm_group_t *group = NULL;
+
+	/* the record hash */
+	uint64_t hash = 0;
+
+	/* the time the record was logged, in milliseconds */
+	uint64_t logged = 0;
+
+	/* the number of similar messages passed in each window */
+	unsigned int threshold = 0;
+
+	/* the sample length */
+	size_t length = 0;
+
+	/* a loop index */
+	unsigned int i = 0;
+
+	/* a flag which indicates whether the group was found */
+	bool is_found = false;
+
+	assert(NULL != storm);
+	assert(NULL != record);
+	assert(NULL != report);
+	assert(NULL != is_reported);
+
+	*is_reported = false;
+
+	/* messages of high priority are never suppressed */
+	threshold = g_thresholds[record->priority];
+	if (0 == threshold) {
+		return false;
+	}
+
+	/* windows are measured in the time records were logged, not the time
+	 * they are read, so records read at once, e.g after a restart, are not
+	 * mistaken for a storm */
+	logged = record->timestamp / 1000;
+
+	/* look for the group of similar messages; if it is not there, replace
+	 * the least recently active group */
+	hash = _hash(record->text, record->length);
+	group = &storm->groups[0];
+	for ( ; STORM_GROUPS > i; ++i) {
+		if ((true == storm->groups[i].is_used) &&
+		    (hash == storm->groups[i].hash) &&
+		    (record->priority == storm->groups[i].priority)) {
+			group = &storm->groups[i];
+			is_found = true;
+			break;
+		}
+		if (false == storm->groups[i].is_used) {
+			group = &storm->groups[i];
+			continue;
+		}
+		if ((true == group->is_used) &&
+		    (storm->groups[i].last < group->last)) {
+			group = &storm->groups[i];
+		}
+	}
+
+	/* if the group is replaced, or its window has passed, report the
+	 * messages suppressed in it and start a new window */
+	if ((false == is_found) || (logged >= group->deadline)) {
+		if ((true == group->is_used) && (0 < group->suppressed)) {
+			_report(group, logged, report);
+			*is_reported = true;
+		}
+		group->deadline = logged + STORM_WINDOW;
+		group->hash = hash;
+		group->count = 0;
+		group->suppressed = 0;
+		group->facility = record->facility;
+		group->priority = record->priority;
+		group->is_used = true;
+		length = record->length;
+		if (STORM_SAMPLE_LENGTH < length) {
+			length = STORM_SAMPLE_LENGTH;
+		}
+		(void) memcpy(group->sample, record->text, length);
+		group->sample[length] = '\0';
+	}
+	group->last = logged;
+
+	/* pass the first similar messages of each window and suppress the
+	 * rest */
+	++group->count;
+	if (threshold >= group->count) {
+		return false;
+	}
+	++group->suppressed;
+	return true;
+}
+
+bool storm_expire(storm_t *storm, const uint64_t now, kmsg_record_t *report) {
+	/* a loop index */
+	unsigned int i = 0;
+
+	assert(NULL != storm);
+	assert(NULL != report);
+
+	/* report messages suppressed in windows which have passed, one group at
+	 * a time */
+	for ( ; STORM_GROUPS > i; ++i) {
+		if ((0 < storm->groups[i].suppressed) &&
+		    (now >= storm->groups[i].deadline)) {
+			_report(&storm->groups[i], now, report);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int storm_get_timeout(const storm_t *storm, const uint64_t now) {
+	/* the earliest deadline */
+	uint64_t deadline = UINT64_MAX;
+
+	/* a loop index */
+	unsigned int i = 0;
+
+	assert(NULL != storm);
+
+	for ( ; STORM_GROUPS > i; ++i) {
+		if ((0 < storm->groups[i].suppressed) &&
+		    (deadline > storm->groups[i].deadline)) {
+			deadline = storm->groups[i].deadline;
+		}
+	}
+
+	/* if no suppressed messages are pending, there is no deadline */
+	if (UINT64_MAX == deadline) {
+		return -1;
+	}
+	if (now >= deadline) {
+		return 0;
+	}
+
+	return (int) (deadline - now);
+}
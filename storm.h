@@ -0,0 +1,45 @@
+#ifndef _STORM_H_INCLUDED
+#	define _STORM_H_INCLUDED
+
+#	include <stdint.h>
+#	include <stdbool.h>
+
+#	include "kmsg.h"
+
+/* the number of similar message groups tracked */
+#	define STORM_GROUPS (64)
+
+/* the length of the window, in milliseconds, similar messages are counted
+ * in */
+#	define STORM_WINDOW (5000)
+
+/* the maximum length of the sample of suppressed messages in reports */
+#	define STORM_SAMPLE_LENGTH (128)
+
+typedef struct {
+	uint64_t deadline;
+	uint64_t last;
+	uint64_t hash;
+	unsigned int count;
+	unsigned int suppressed;
+	int facility;
+	int priority;
+	bool is_used;
+	char sample[1 + STORM_SAMPLE_LENGTH];
+} storm_group_t;
+
+typedef struct {
+	storm_group_t groups[STORM_GROUPS];
+} storm_t;
+
+void storm_init(storm_t *storm);
+
+bool storm_is_suppressed(storm_t *storm,
+                         const kmsg_record_t *record,
+                         kmsg_record_t *report,
+                         bool *is_reported);
+bool storm_expire(storm_t *storm, const uint64_t now, kmsg_record_t *report);
+
+int storm_get_timeout(const storm_t *storm, const uint64_t now);
+
+#endif
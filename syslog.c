@@ -3,70 +3,1251 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <signal.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <syslog.h>
+#include <time.h>
+#include <errno.h>
+#include <regex.h>
+#include <assert.h>
 
 #include "common.h"
 #include "syslog.h"
+#include "codec.h"
+#include "message.h"
+#include "record.h"
+#include "search.h"
+#include "mirror.h"
+#include "block.h"
+
+/* the size of the chunks the log is read in */
+#define CHUNK_SIZE (64 * 1024)
+
+/* the size of the buffer inotify events are received in */
+#define EVENTS_SIZE (4096)
 
 /* the usage message */
-#define USAGE "Usage: syslog\n"
+#define USAGE \
+	"Usage: syslog [-l LOG] [-p PRIORITY] [-s TIME] [-e TIME] [-t TAG] " \
+	"[-m TEXT | -r REGEX] | [-n COUNT] [-f] | [-M [-n COUNT]]\n"
 
-int main(int argc, char *argv[]) {
-	/* a log chunk */
-	char chunk[1 + MAX_MESSAGE_LENGTH] = {'\0'};
+typedef struct {
+	size_t length;
+	char buffer[CHUNK_SIZE];
+} output_t;
 
-	/* the chunk size */
-	ssize_t size = 0;
+typedef struct {
+	int fd;
+	int wd;
+	off_t offset;
+	bool is_known;
+	bool is_binary;
+} follower_t;
 
-	/* a loop index */
-	ssize_t i = 0;
+static bool _flush(output_t *output) {
+	assert(NULL != output);
 
-	/* the exit code */
-	int exit_code = EXIT_FAILURE;
+	if ((0 < output->length) &&
+	    ((ssize_t) output->length != write(STDOUT_FILENO,
+	                                       output->buffer,
+	                                       output->length))) {
+		return false;
+	}
 
-	/* the log file */
-	int log_file = 0;
+	output->length = 0;
+	return true;
+}
 
-	/* make sure the number of command-line arguments is valid */
-	if (1 != argc) {
-		PRINT(USAGE);
-		goto end;
+static bool _print(output_t *output, const char *line, const size_t length) {
+	assert(NULL != output);
+	assert(NULL != line);
+	assert(sizeof(output->buffer) > length);
+
+	/* make room for the line and a line break */
+	if (((sizeof(output->buffer) - output->length) <= length) &&
+	    (false == _flush(output))) {
+		return false;
 	}
 
-	/* open the log file */
-	log_file = open(LOG_FILE_PATH, O_RDONLY);
-	if (-1 == log_file) {
-		goto end;
+	(void) memcpy(&output->buffer[output->length], line, length);
+	output->length += length;
+
+	/* make sure the line ends with a line break */
+	if ((0 == length) || ('\n' != line[length - 1])) {
+		output->buffer[output->length] = '\n';
+		++output->length;
 	}
 
+	return true;
+}
+
+static bool _dump(const int log_file) {
+	/* a log chunk */
+	static char chunk[CHUNK_SIZE] = {'\0'};
+
+	/* the chunk size */
+	ssize_t size = 0;
+
 	do {
 		/* read a log chunk */
 		size = read(log_file, (void *) chunk, sizeof(chunk));
 		switch (size) {
 			case 0:
-				exit_code = EXIT_SUCCESS;
+				return true;
 
 			case (-1):
-				goto close_log;
+				return false;
 
 			default:
 				/* de-XOR the chunk */
-				for (i = 0; size > i; ++i) {
-					chunk[i] ^= XOR_KEY;
-				}
+				codec_xor(chunk, chunk, (size_t) size);
 
 				/* write it to standard output */
 				if (size != write(STDOUT_FILENO,
 				                  (void *) chunk,
 				                  (size_t) size)) {
-					goto close_log;
+					return false;
 				}
 		}
 	} while (1);
+}
+
+static bool _print_record(output_t *output,
+                          const char *contents,
+                          const size_t offset,
+                          const record_header_t *header) {
+	/* a message */
+	char text[1 + MAX_MESSAGE_LENGTH] = {'\0'};
+
+	/* display the message, unless it is corrupt */
+	codec_xor(text, &contents[offset + sizeof(*header)], header->length);
+	if (false == record_is_valid(header, text)) {
+		return true;
+	}
+	return _print(output, text, header->length);
+}
+
+static bool _print_encoded(output_t *output,
+                           const char *contents,
+                           size_t size) {
+	/* the size of the current chunk */
+	size_t length = 0;
+
+	assert(NULL != output);
+	assert(NULL != contents);
+
+	/* decode the contents into the output buffer */
+	for ( ; 0 < size; size -= length) {
+		if (sizeof(output->buffer) == output->length) {
+			if (false == _flush(output)) {
+				return false;
+			}
+		}
+		length = sizeof(output->buffer) - output->length;
+		if (size < length) {
+			length = size;
+		}
+		codec_xor(&output->buffer[output->length], contents, length);
+		output->length += length;
+		contents += length;
+	}
+
+	return true;
+}
+
+static size_t _tail_text(const char *contents,
+                         const size_t size,
+                         const unsigned int count,
+                         size_t *start) {
+	/* a line break, once encoded */
+	const char encoded_line_break = (char) ('\n' ^ XOR_KEY);
+
+	/* the current line break */
+	const char *line_break = NULL;
+
+	/* the size of the part of the segment before the current line */
+	size_t end = size;
+
+	/* the number of lines found */
+	unsigned int lines = 0;
+
+	/* the last line ends with a line break */
+	if ((0 < end) && (encoded_line_break == contents[end - 1])) {
+		--end;
+	}
+
+	/* find line breaks from the end, without decoding anything */
+	for (*start = size; (count > lines) && (0 < end); ++lines) {
+		line_break = memrchr(contents, encoded_line_break, end);
+		if (NULL == line_break) {
+			end = 0;
+		} else {
+			end = (size_t) (line_break - contents);
+		}
+		*start = (NULL == line_break) ? 0 : (1 + end);
+	}
+
+	return lines;
+}
+
+static size_t _tail_records(const char *contents,
+                            const char *path,
+                            const size_t size,
+                            const unsigned int count,
+                            size_t *start,
+                            size_t *skipped) {
+	/* the segment index */
+	record_index_t index = {0};
+
+	/* a record header */
+	record_header_t header = {0};
+
+	/* the offset of the current record */
+	size_t offset = 0;
+
+	/* the end of the records counted so far */
+	size_t end = size;
+
+	/* the number of records found */
+	size_t records = 0;
+
+	/* a loop index */
+	size_t i = 0;
+
+	record_map_index(path, &index);
+
+	/* count records from the last index entry backwards, until there are
+	 * enough of them */
+	for (i = index.count; ; --i) {
+		*start = record_get_offset(&index, i, size);
+		if (*start >= end) {
+			*start = RECORD_MAGIC_SIZE;
+			i = 0;
+		}
+		for (offset = *start;
+		     (end > offset) &&
+		     (true == record_read_header(contents, size, offset, &header));
+		     offset += sizeof(header) + header.length) {
+			++records;
+		}
+		end = *start;
+		if ((count <= records) || (0 == i)) {
+			break;
+		}
+	}
+
+	record_unmap_index(&index);
+
+	/* skip the extra records at the beginning */
+	*skipped = 0;
+	if (count < records) {
+		*skipped = records - count;
+		records = count;
+	}
+
+	return records;
+}
+
+static bool _get_segment_path(char *path,
+                              const char *log_path,
+                              const unsigned int segment) {
+	/* the current segment is 0 and old ones are numbered from 1 */
+	if (0 == segment) {
+		(void) strcpy(path, log_path);
+		return true;
+	}
+
+	return (PATH_MAX > snprintf(path,
+	                            PATH_MAX,
+	                            LOG_SEGMENT_FORMAT,
+	                            log_path,
+	                            segment));
+}
+
+static bool _is_binary(const char *contents, const size_t size) {
+	/* the segment header */
+	char magic[RECORD_MAGIC_SIZE] = {'\0'};
+
+	if (sizeof(magic) > size) {
+		return false;
+	}
+
+	codec_xor(magic, contents, sizeof(magic));
+	return (0 == memcmp(magic, RECORD_MAGIC, sizeof(magic)));
+}
+
+static bool _decompress_tail(block_segment_t *segment,
+                             const char *path,
+                             const unsigned int count) {
+	/* the segment index */
+	record_index_t index = {0};
+
+	/* the start of the decompressed range */
+	size_t start = 0;
+
+	/* the offset of the first line found in it */
+	size_t line_start = 0;
+
+	/* the number of lines found */
+	size_t found = 0;
+
+	/* the number of blocks decompressed from the end */
+	size_t blocks = 1;
+
+	/* the index entry of the first record displayed, at most */
+	size_t i = 0;
+
+	assert(NULL != segment);
+	assert(NULL != path);
+
+	/* the format of the original segment is told by its header */
+	if (false == block_decompress(segment, 0, 1)) {
+		return false;
+	}
+
+	/* segments made of records are indexed every RECORD_INDEX_INTERVAL
+	 * records, so the index tells where the last records start */
+	if (true == _is_binary(segment->data, segment->size)) {
+		record_map_index(path, &index);
+		i = 1 + (count / RECORD_INDEX_INTERVAL);
+		i = (index.count > i) ? (index.count - i) : 0;
+		start = record_get_offset(&index, i, segment->size);
+		record_unmap_index(&index);
+		return block_decompress(segment, start, segment->size);
+	}
+
+	/* in segments made of text, decompress more blocks from the end, until
+	 * they contain enough lines */
+	do {
+		start = 0;
+		if ((segment->size / BLOCK_SIZE) > blocks) {
+			start = segment->size - (blocks * BLOCK_SIZE);
+		}
+		if (false == block_decompress(segment, start, segment->size)) {
+			return false;
+		}
+		found = _tail_text(&segment->data[start],
+		                   segment->size - start,
+		                   count,
+		                   &line_start);
+		if ((0 == start) || ((count <= found) && (0 < line_start))) {
+			return true;
+		}
+		blocks *= 2;
+	} while (1);
+}
+
+static bool _tail(const char *log_path,
+                  const unsigned int segment,
+                  const unsigned int count,
+                  output_t *output,
+                  off_t *end) {
+	/* the segment path */
+	char path[PATH_MAX] = {'\0'};
+
+	/* the log file attributes */
+	struct stat attributes = {0};
+
+	/* a record header */
+	record_header_t header = {0};
+
+	/* the compressed segment */
+	block_segment_t segment_blocks = {0};
+
+	/* the log contents */
+	const char *contents = NULL;
+
+	/* the segment contents, decompressed if needed */
+	const char *data = NULL;
+
+	/* the segment size, decompressed */
+	size_t size = 0;
+
+	/* the number of messages found */
+	size_t found = 0;
+
+	/* the offset of the first message displayed */
+	size_t start = 0;
+
+	/* the number of records skipped */
+	size_t skipped = 0;
+
+	/* the return value */
+	bool result = false;
+
+	/* a flag which indicates whether the segment is made of records */
+	bool is_binary = false;
+
+	/* a flag which indicates whether the segment is compressed */
+	bool is_compressed = false;
+
+	/* the log file */
+	int log_file = 0;
+
+	assert(NULL != output);
+
+	if (false == _get_segment_path(path, log_path, segment)) {
+		goto end;
+	}
+
+	/* open the log file; if there is no such segment, there is nothing
+	 * left to display */
+	log_file = open(path, O_RDONLY);
+	if (-1 == log_file) {
+		result = true;
+		goto end;
+	}
+	if (-1 == fstat(log_file, &attributes)) {
+		goto close_log;
+	}
+	if (NULL != end) {
+		*end = attributes.st_size;
+	}
+	if (0 == attributes.st_size) {
+		result = _tail(log_path, 1 + segment, count, output, NULL);
+		goto close_log;
+	}
+
+	/* map the log file; only the displayed part of it is read */
+	contents = mmap(NULL,
+	                (size_t) attributes.st_size,
+	                PROT_READ,
+	                MAP_PRIVATE,
+	                log_file,
+	                0);
+	if (MAP_FAILED == contents) {
+		goto close_log;
+	}
+	data = contents;
+	size = (size_t) attributes.st_size;
+
+	/* if the segment is compressed, decompress only its end */
+	is_compressed = block_is_compressed(contents, size);
+	if (true == is_compressed) {
+		if (false == block_open(&segment_blocks, contents, size)) {
+			goto unmap;
+		}
+		if (false == _decompress_tail(&segment_blocks, path, count)) {
+			goto close_blocks;
+		}
+		data = segment_blocks.data;
+		size = segment_blocks.size;
+	}
+
+	is_binary = _is_binary(data, size);
+	if (true == is_binary) {
+		found = _tail_records(data, path, size, count, &start, &skipped);
+	} else {
+		found = _tail_text(data, size, count, &start);
+	}
+
+	/* if there are not enough messages, display the end of the previous
+	 * segment first */
+	if ((count > found) &&
+	    (false == _tail(log_path,
+	                    1 + segment,
+	                    count - (unsigned int) found,
+	                    output,
+	                    NULL))) {
+		goto close_blocks;
+	}
+
+	if (false == is_binary) {
+		result = _print_encoded(output, &data[start], size - start);
+		goto close_blocks;
+	}
+
+	for ( ;
+	     true == record_read_header(data, size, start, &header);
+	     start += sizeof(header) + header.length) {
+		if (0 < skipped) {
+			--skipped;
+			continue;
+		}
+		if (false == _print_record(output, data, start, &header)) {
+			goto close_blocks;
+		}
+	}
+	result = true;
+
+close_blocks:
+	if (true == is_compressed) {
+		block_close(&segment_blocks);
+	}
+
+unmap:
+	(void) munmap((void *) contents, (size_t) attributes.st_size);
+
+close_log:
+	/* close the log file */
+	(void) close(log_file);
+
+end:
+	return result;
+}
+
+static bool _show_compressed(const char *path,
+                             const char *contents,
+                             const size_t size,
+                             const filter_t *filter,
+                             output_t *output) {
+	/* the compressed segment */
+	block_segment_t segment = {0};
+
+	/* the segment index */
+	record_index_t index = {0};
+
+	/* the range of the segment displayed */
+	size_t start = 0;
+	size_t end = 0;
+
+	/* the return value */
+	bool result = false;
+
+	/* a flag which indicates whether the segment is made of records */
+	bool is_binary = false;
+
+	assert(NULL != path);
+	assert(NULL != contents);
+	assert(NULL != filter);
+	assert(NULL != output);
+
+	if (false == block_open(&segment, contents, size)) {
+		goto end;
+	}
+	end = segment.size;
+
+	/* the format of the original segment is told by its header */
+	if (false == block_decompress(&segment, 0, 1)) {
+		goto close_segment;
+	}
+	is_binary = _is_binary(segment.data, segment.size);
+
+	/* in segments made of records, decompress only the blocks of the time
+	 * range, which is found through the index */
+	if (true == is_binary) {
+		record_map_index(path, &index);
+		if (INT64_MIN != filter->since) {
+			start = record_find(&index, segment.size, filter->since);
+		}
+		if (INT64_MAX != filter->until) {
+			end = record_find_end(&index, segment.size, filter->until);
+		}
+		record_unmap_index(&index);
+		if (start > end) {
+			result = true;
+			goto close_segment;
+		}
+	}
+	if (false == block_decompress(&segment, start, end)) {
+		goto close_segment;
+	}
+
+	/* then, display it like a segment which is not compressed */
+	if ((false == is_binary) && (false == filter->is_filtered)) {
+		result = ((true == _print_encoded(output, segment.data, end)) &&
+		          (true == _flush(output)));
+	} else {
+		result = search_segment(segment.data, end, path, is_binary, filter);
+	}
+
+close_segment:
+	block_close(&segment);
+
+end:
+	return result;
+}
+
+static bool _show(const char *path,
+                  const filter_t *filter,
+                  output_t *output) {
+	/* the segment header */
+	char magic[RECORD_MAGIC_SIZE] = {'\0'};
+
+	/* the log file attributes */
+	struct stat attributes = {0};
+
+	/* the log contents */
+	const char *contents = NULL;
+
+	/* the return value */
+	bool result = false;
+
+	/* a flag which indicates whether the log file is made of records */
+	bool is_binary = false;
+
+	/* a flag which indicates whether the log file is compressed */
+	bool is_compressed = false;
+
+	/* the log file */
+	int log_file = 0;
+
+	assert(NULL != path);
+	assert(NULL != filter);
+	assert(NULL != output);
+
+	/* open the log file */
+	log_file = open(path, O_RDONLY);
+	if (-1 == log_file) {
+		goto end;
+	}
+	if (-1 == fstat(log_file, &attributes)) {
+		goto close_log;
+	}
+	if (0 == attributes.st_size) {
+		result = true;
+		goto close_log;
+	}
+
+	/* display the log file, or the messages in it that match the filter,
+	 * which is done in parallel; if the log file is made of text and there is
+	 * no filter, it is faster to display the whole file */
+	if (false == _flush(output)) {
+		goto close_log;
+	}
+	if (sizeof(magic) == pread(log_file, magic, sizeof(magic), 0)) {
+		is_binary = _is_binary(magic, sizeof(magic));
+		is_compressed = block_is_compressed(magic, sizeof(magic));
+	}
+	if ((false == is_binary) &&
+	    (false == is_compressed) &&
+	    (false == filter->is_filtered)) {
+		result = _dump(log_file);
+		goto close_log;
+	}
+
+	contents = mmap(NULL,
+	                (size_t) attributes.st_size,
+	                PROT_READ,
+	                MAP_PRIVATE,
+	                log_file,
+	                0);
+	if (MAP_FAILED != contents) {
+		if (true == is_compressed) {
+			result = _show_compressed(path,
+			                          contents,
+			                          (size_t) attributes.st_size,
+			                          filter,
+			                          output);
+		} else {
+			result = search_segment(contents,
+			                        (size_t) attributes.st_size,
+			                        path,
+			                        is_binary,
+			                        filter);
+		}
+		(void) munmap((void *) contents, (size_t) attributes.st_size);
+	}
 
 close_log:
 	/* close the log file */
 	(void) close(log_file);
 
+end:
+	return result;
+}
+
+static bool _read_appended(follower_t *follower, output_t *output) {
+	/* a log chunk */
+	static char chunk[CHUNK_SIZE] = {'\0'};
+
+	/* a record header */
+	record_header_t header = {0};
+
+	/* the log file attributes */
+	struct stat attributes = {0};
+
+	/* the chunk size */
+	ssize_t size = 0;
+
+	/* the offset of the current record in the chunk */
+	size_t offset = 0;
+
+	assert(NULL != follower);
+	assert(NULL != output);
+
+	if (-1 == fstat(follower->fd, &attributes)) {
+		return false;
+	}
+
+	/* if the segment was truncated, start over */
+	if (follower->offset > attributes.st_size) {
+		follower->offset = 0;
+		follower->is_known = false;
+	}
+
+	/* determine the segment format, once its header is written; a segment
+	 * which does not start like a header is made of text, even if it is
+	 * shorter */
+	if (false == follower->is_known) {
+		size = pread(follower->fd, chunk, RECORD_MAGIC_SIZE, 0);
+		if (-1 == size) {
+			return false;
+		}
+		if (RECORD_MAGIC_SIZE != size) {
+			codec_xor(chunk, chunk, (size_t) size);
+			if (0 == memcmp(chunk, RECORD_MAGIC, (size_t) size)) {
+				return true;
+			}
+		}
+		follower->is_binary = _is_binary(chunk, (size_t) size);
+		follower->is_known = true;
+		if ((true == follower->is_binary) &&
+		    (RECORD_MAGIC_SIZE > follower->offset)) {
+			follower->offset = RECORD_MAGIC_SIZE;
+		}
+	}
+
+	/* decode only the appended part of the segment */
+	while (attributes.st_size > follower->offset) {
+		size = pread(follower->fd, chunk, sizeof(chunk), follower->offset);
+		if (0 >= size) {
+			return (0 == size);
+		}
+
+		if (false == follower->is_binary) {
+			if (false == _print_encoded(output, chunk, (size_t) size)) {
+				return false;
+			}
+			follower->offset += size;
+			continue;
+		}
+
+		/* display complete records; an incomplete one is displayed once the
+		 * rest of it is written */
+		for (offset = 0;
+		     true == record_read_header(chunk, (size_t) size, offset, &header);
+		     offset += sizeof(header) + header.length) {
+			if (false == _print_record(output, chunk, offset, &header)) {
+				return false;
+			}
+		}
+		if (0 == offset) {
+			break;
+		}
+		follower->offset += offset;
+	}
+
+	return _flush(output);
+}
+
+static bool _open_current(follower_t *follower,
+                          const char *log_path,
+                          const int inotify_fd) {
+	assert(NULL != follower);
+	assert(NULL != log_path);
+
+	/* if the current segment does not exist yet, wait until it is
+	 * created */
+	follower->fd = open(log_path, O_RDONLY);
+	if (-1 == follower->fd) {
+		return (ENOENT == errno);
+	}
+
+	/* watch it for appends, and for rotation */
+	follower->wd = inotify_add_watch(inotify_fd,
+	                                 log_path,
+	                                 IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF);
+	if (-1 == follower->wd) {
+		(void) close(follower->fd);
+		follower->fd = -1;
+		return false;
+	}
+
+	return true;
+}
+
+static void _close_current(follower_t *follower, const int inotify_fd) {
+	assert(NULL != follower);
+
+	(void) inotify_rm_watch(inotify_fd, follower->wd);
+	(void) close(follower->fd);
+	follower->fd = -1;
+	follower->offset = 0;
+	follower->is_known = false;
+}
+
+static bool _follow(const char *log_path,
+                    const off_t offset,
+                    output_t *output) {
+	/* the log directory */
+	char directory[PATH_MAX] = {'\0'};
+
+	/* inotify events */
+	char events[EVENTS_SIZE]
+	           __attribute__((aligned(__alignof__(struct inotify_event))));
+
+	/* the signals which stop following the log */
+	sigset_t signals = {{0}};
+
+	/* the inotify instance and the signal descriptor */
+	struct pollfd fds[2] = {{0}};
+
+	/* the current segment */
+	follower_t follower = {-1, -1, 0, false, false};
+
+	/* an inotify event */
+	const struct inotify_event *event = NULL;
+
+	/* the size of the received events */
+	ssize_t size = 0;
+
+	/* the offset of the current event */
+	ssize_t i = 0;
+
+	/* the inotify instance */
+	int inotify_fd = -1;
+
+	/* the log file name */
+	const char *name = NULL;
+
+	/* the log directory watch descriptor */
+	int directory_wd = -1;
+
+	/* the signal descriptor */
+	int signal_fd = -1;
+
+	/* the return value */
+	bool result = false;
+
+	assert(NULL != log_path);
+	assert(NULL != output);
+
+	/* split the log path into a directory and a file name */
+	name = strrchr(log_path, '/');
+	if (NULL == name) {
+		(void) strcpy(directory, ".");
+		name = log_path;
+	} else {
+		if (name == log_path) {
+			(void) strcpy(directory, "/");
+		} else {
+			(void) memcpy(directory, log_path, (size_t) (name - log_path));
+		}
+		++name;
+	}
+
+	/* receive SIGINT and SIGTERM through a descriptor, so following the log
+	 * can be stopped cleanly */
+	if ((-1 == sigemptyset(&signals)) ||
+	    (-1 == sigaddset(&signals, SIGINT)) ||
+	    (-1 == sigaddset(&signals, SIGTERM)) ||
+	    (-1 == sigprocmask(SIG_BLOCK, &signals, NULL))) {
+		goto end;
+	}
+	signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+	if (-1 == signal_fd) {
+		goto end;
+	}
+
+	inotify_fd = inotify_init1(IN_CLOEXEC);
+	if (-1 == inotify_fd) {
+		goto close_signal_fd;
+	}
+
+	/* watch the log directory for new segments */
+	directory_wd = inotify_add_watch(inotify_fd,
+	                                 directory,
+	                                 IN_CREATE | IN_MOVED_TO);
+	if (-1 == directory_wd) {
+		goto close_inotify;
+	}
+
+	/* display everything appended since the current segment was displayed */
+	if (false == _open_current(&follower, log_path, inotify_fd)) {
+		goto close_inotify;
+	}
+	if (-1 != follower.fd) {
+		follower.offset = offset;
+		if (false == _read_appended(&follower, output)) {
+			goto close_log;
+		}
+	}
+
+	fds[0].fd = inotify_fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = signal_fd;
+	fds[1].events = POLLIN;
+	do {
+		if (-1 == poll(fds, ARRAY_SIZE(fds), -1)) {
+			break;
+		}
+		if (0 != fds[1].revents) {
+			result = true;
+			break;
+		}
+
+		size = read(inotify_fd, events, sizeof(events));
+		if (0 >= size) {
+			break;
+		}
+
+		for (i = 0; size > i; i += sizeof(*event) + event->len) {
+			event = (const struct inotify_event *) &events[i];
+
+			if (directory_wd == event->wd) {
+				if ((0 == event->len) ||
+				    (0 != strcmp(event->name, name))) {
+					continue;
+				}
+
+				/* once a new segment is created, display the rest of the
+				 * previous one and follow the new one */
+				if (-1 != follower.fd) {
+					if (false == _read_appended(&follower, output)) {
+						goto close_log;
+					}
+					_close_current(&follower, inotify_fd);
+				}
+				if (false == _open_current(&follower, log_path, inotify_fd)) {
+					goto close_log;
+				}
+			} else if (follower.wd != event->wd) {
+				continue;
+			}
+
+			if (-1 == follower.fd) {
+				continue;
+			}
+
+			/* display all appended messages, even if the segment was just
+			 * rotated */
+			if (false == _read_appended(&follower, output)) {
+				goto close_log;
+			}
+			if (0 != (event->mask & (IN_MOVE_SELF | IN_DELETE_SELF))) {
+				_close_current(&follower, inotify_fd);
+			}
+		}
+	} while (1);
+
+close_log:
+	if (-1 != follower.fd) {
+		_close_current(&follower, inotify_fd);
+	}
+
+close_inotify:
+	(void) close(inotify_fd);
+
+close_signal_fd:
+	(void) close(signal_fd);
+
+end:
+	return result;
+}
+
+static bool _show_recent(const unsigned int count, output_t *output) {
+	/* the copy of the shared ring */
+	static char ring[MIRROR_SIZE] = {'\0'};
+
+	/* a message */
+	char text[1 + MAX_MESSAGE_LENGTH] = {'\0'};
+
+	/* the shared ring */
+	mirror_t mirror = {0};
+
+	/* the current message */
+	const char *message = NULL;
+
+	/* the copy size */
+	size_t size = 0;
+
+	/* the offset of the current message */
+	size_t offset = 0;
+
+	/* the message length */
+	size_t length = 0;
+
+	/* the number of messages to skip */
+	size_t skipped = 0;
+
+	assert(NULL != output);
+
+	/* copy the recent messages published by syslogd, or left behind by one
+	 * that crashed, without touching the disk */
+	if (false == mirror_map(&mirror, MIRROR_PATH)) {
+		return false;
+	}
+	if (false == mirror_copy(&mirror, ring, &size)) {
+		mirror_close(&mirror);
+		return false;
+	}
+	mirror_close(&mirror);
+
+	/* if only the last messages are displayed, skip the others */
+	if (0 < count) {
+		while (true == mirror_next(ring, size, &offset, &message, &length)) {
+			++skipped;
+		}
+		skipped = (count < skipped) ? (skipped - count) : 0;
+		offset = 0;
+	}
+
+	while (true == mirror_next(ring, size, &offset, &message, &length)) {
+		if (0 < skipped) {
+			--skipped;
+			continue;
+		}
+		codec_xor(text, message, length);
+		if (false == _print(output, text, length)) {
+			return false;
+		}
+	}
+
+	return _flush(output);
+}
+
+static bool _parse_time(const char *value, int64_t *time_value) {
+	/* the current time */
+	struct timespec now = {0};
+
+	/* the parsed value */
+	long long seconds = 0;
+
+	/* the end of the parsed value */
+	char *end = NULL;
+
+	seconds = strtoll(value, &end, 10);
+	if (('\0' == value[0]) || ('\0' != end[0])) {
+		return false;
+	}
+
+	/* negative times are relative to the current time */
+	if (0 > seconds) {
+		if (-1 == clock_gettime(CLOCK_REALTIME, &now)) {
+			return false;
+		}
+		seconds += (long long) now.tv_sec;
+	}
+
+	*time_value = (int64_t) seconds * 1000000000;
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	/* the output buffer */
+	static output_t output = {0};
+
+	/* a log segment path */
+	char path[PATH_MAX] = {'\0'};
+
+	/* the message filter */
+	filter_t filter = {
+		NULL, NULL, INT64_MIN, INT64_MAX, LOG_DEBUG, false, false
+	};
+
+	/* a log segment attributes */
+	struct stat attributes = {0};
+
+	/* a regular expression */
+	regex_t regex = {0};
+
+	/* the log path */
+	const char *log_path = LOG_FILE_PATH;
+
+	/* the number of old log segments */
+	unsigned int segments = 0;
+
+	/* the number of messages to display, from the end */
+	long count = 0;
+
+	/* the lowest priority of displayed messages */
+	long priority = 0;
+
+	/* the size of the current log segment, once displayed */
+	off_t end = 0;
+
+	/* the exit code */
+	int exit_code = EXIT_FAILURE;
+
+	/* a command-line option */
+	int option = 0;
+
+	/* the end of a numeric command-line option */
+	char *option_end = NULL;
+
+	/* a flag which indicates whether to display new messages as they are
+	 * written */
+	bool is_following = false;
+
+	/* a flag which indicates whether to display recent messages from the
+	 * shared ring */
+	bool is_recent = false;
+
+	/* parse the command-line */
+	do {
+		option = getopt(argc, argv, "l:p:s:e:t:m:r:n:fM");
+		if (-1 == option) {
+			break;
+		}
+
+		switch (option) {
+			case 'l':
+				if (PATH_MAX <= strlen(optarg)) {
+					PRINT(USAGE);
+					goto end;
+				}
+				log_path = optarg;
+				break;
+
+			case 'p':
+				priority = strtol(optarg, &option_end, 10);
+				if ((optarg == option_end) ||
+				    ('\0' != *option_end) ||
+				    (LOG_EMERG > priority) ||
+				    (LOG_DEBUG < priority)) {
+					PRINT(USAGE);
+					goto end;
+				}
+				filter.priority = (int) priority;
+				filter.is_filtered = true;
+				break;
+
+			case 's':
+				if (false == _parse_time(optarg, &filter.since)) {
+					PRINT(USAGE);
+					goto end;
+				}
+				filter.is_filtered = true;
+				break;
+
+			case 'e':
+				if (false == _parse_time(optarg, &filter.until)) {
+					PRINT(USAGE);
+					goto end;
+				}
+				filter.is_filtered = true;
+				break;
+
+			case 't':
+				filter.tag = optarg;
+				filter.is_filtered = true;
+				break;
+
+			case 'r':
+				/* make sure the regular expression is valid; each searching
+				 * thread compiles it again */
+				if (0 != regcomp(&regex, optarg, REG_EXTENDED | REG_NOSUB)) {
+					PRINT(USAGE);
+					goto end;
+				}
+				regfree(&regex);
+				filter.is_regex = true;
+
+				/* fall through */
+
+			case 'm':
+				if (NULL != filter.pattern) {
+					PRINT(USAGE);
+					goto end;
+				}
+				filter.pattern = optarg;
+				filter.is_filtered = true;
+				break;
+
+			case 'n':
+				count = strtol(optarg, &option_end, 10);
+				if ((optarg == option_end) ||
+				    ('\0' != *option_end) ||
+				    (0 >= count) ||
+				    (UINT_MAX < count)) {
+					PRINT(USAGE);
+					goto end;
+				}
+				break;
+
+			case 'f':
+				is_following = true;
+				break;
+
+			case 'M':
+				is_recent = true;
+				break;
+
+			default:
+				PRINT(USAGE);
+				goto end;
+		}
+	} while (1);
+
+	/* make sure the number of command-line arguments is valid; filters
+	 * cannot be combined with -n or -f, and -M can be combined only with
+	 * -n */
+	if ((argc != optind) ||
+	    ((true == filter.is_filtered) &&
+	     ((0 < count) || (true == is_following) || (true == is_recent))) ||
+	    ((true == is_recent) && (true == is_following))) {
+		PRINT(USAGE);
+		goto end;
+	}
+
+	if (true == is_recent) {
+		if (true == _show_recent((unsigned int) count, &output)) {
+			exit_code = EXIT_SUCCESS;
+		}
+		goto end;
+	}
+
+	if ((0 < count) || (true == is_following)) {
+		/* display the last messages, scanning the log from its end */
+		if (0 < count) {
+			if ((false == _tail(log_path,
+			                    0,
+			                    (unsigned int) count,
+			                    &output,
+			                    &end)) ||
+			    (false == _flush(&output))) {
+				goto end;
+			}
+		} else if (0 == stat(log_path, &attributes)) {
+			end = attributes.st_size;
+		}
+
+		/* then, display new messages until killed */
+		if ((true == is_following) &&
+		    (false == _follow(log_path, end, &output))) {
+			goto end;
+		}
+
+		exit_code = EXIT_SUCCESS;
+		goto end;
+	}
+
+	/* count the old log segments */
+	do {
+		if (false == _get_segment_path(path, log_path, 1 + segments)) {
+			goto end;
+		}
+		if (-1 == stat(path, &attributes)) {
+			break;
+		}
+		++segments;
+	} while (1);
+
+	/* display the old log segments, from the oldest to the newest */
+	for ( ; 0 < segments; --segments) {
+		if (false == _get_segment_path(path, log_path, segments)) {
+			goto end;
+		}
+		if (false == _show(path, &filter, &output)) {
+			goto end;
+		}
+	}
+
+	/* display the current log segment */
+	if ((true == _show(log_path, &filter, &output)) &&
+	    (true == _flush(&output))) {
+		exit_code = EXIT_SUCCESS;
+	}
+
 end:
 	return exit_code;
 }
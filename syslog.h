@@ -3,8 +3,17 @@
 
 #	include "common.h"
 
+/* the log directory */
+#	define LOG_DIRECTORY "/var/log"
+
+/* the log file name */
+#	define LOG_FILE_NAME "messages"
+
 /* the log file path */
-#	define LOG_FILE_PATH "/var/log/messages"
+#	define LOG_FILE_PATH LOG_DIRECTORY"/"LOG_FILE_NAME
+
+/* the path format of old log segments, from the newest (1) to the oldest */
+#	define LOG_SEGMENT_FORMAT "%s.%u"
 
 /* the maximum length of a log message */
 #	define MAX_MESSAGE_LENGTH (MAX_LENGTH)
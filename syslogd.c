@@ -7,138 +7,895 @@
 #include <sys/un.h>
 #include <string.h>
 #include <errno.h>
+#include <syslog.h>
+#include <assert.h>
+#include <pthread.h>
+#include <limits.h>
 
 #include "common.h"
 #include "daemon.h"
 #include "syslog.h"
+#include "message.h"
+#include "ring.h"
+#include "dedup.h"
+#include "limit.h"
+#include "writer.h"
+#include "route.h"
+#include "forward.h"
+#include "mirror.h"
 
 /* the socket path */
 #define SOCKET_PATH "/dev/log"
 
-/* the log file permissions */
-#define LOG_FILE_PERMISSIONS (0644)
+/* the lowest priority of messages written immediately */
+#define URGENT_PRIORITY LOG_CRIT
+
+/* the default lowest priority of messages which must be durable */
+#define DEFAULT_DURABLE_PRIORITY LOG_ERR
+
+/* the number of messages received at once */
+#define BATCH_SIZE (64)
+
+/* the default maximum size of a log segment, in kilobytes */
+#define DEFAULT_MAX_SIZE (4 * 1024)
+
+/* the default number of old log segments kept */
+#define DEFAULT_SEGMENTS (4)
+
+/* the default number of messages per second a process may send */
+#define DEFAULT_RATE (100)
+
+/* the default number of messages a process may send at once */
+#define DEFAULT_BURST (1000)
+
+/* the interval, in seconds, between reports of suppressed messages */
+#define REPORT_INTERVAL (60)
+
+/* the maximum number of additional sockets */
+#define MAX_SOURCES (64)
+
+/* the maximum length of the label of an additional socket */
+#define MAX_LABEL_LENGTH (16)
+
+/* the separator between the path and the label of an additional socket */
+#define SOURCE_SEPARATOR ':'
 
 /* the usage message */
-#define USAGE "Usage: syslogd\n"
+#define USAGE \
+	"Usage: syslogd [-b] [-r] [-s SIZE] [-n COUNT] [-R RATE] [-B BURST] " \
+	"[-d PRIORITY] [-z] [-u PATH:LABEL]... [-F HOST:PORT [-t]]\n"
 
-int main(int argc, char *argv[]) {
-	/* a log message */
-	char message[2 + MAX_MESSAGE_LENGTH] = {'\0'};
+/* an additional socket, whose messages are labeled */
+typedef struct {
+	const char *path;
+	const char *label;
+	size_t label_length;
+	int fd;
+} source_t;
+
+/* the daemon state, shared by the receiving and writing threads */
+typedef struct {
+	ring_t ring;
+	router_t router;
+	writer_t writers[MAX_DESTINATIONS];
+	forwarder_t forwarder;
+	mirror_t mirror;
+	dedup_t dedup;
+	limit_t limit;
+	int durable_priority;
+	bool is_forwarding;
+} syslogd_t;
+
+static bool _is_limited(const char *text,
+                        const size_t length,
+                        const struct cmsghdr *control) {
+	/* the sender credentials */
+	const struct ucred *credentials = NULL;
+
+	/* the message facility and priority */
+	int facility = 0;
+	int priority = 0;
+
+	/* messages without credentials cannot be attributed to a process */
+	if ((NULL == control) ||
+	    (SOL_SOCKET != control->cmsg_level) ||
+	    (SCM_CREDENTIALS != control->cmsg_type)) {
+		return false;
+	}
+
+	/* kernel messages passed by root, i.e by klogd, are never limited, since
+	 * all of them are replayed at once during boot */
+	credentials = (const struct ucred *) CMSG_DATA(control);
+	if ((0 == credentials->uid) &&
+	    (0 < message_parse_priority(text, length, &facility, &priority)) &&
+	    (LOG_FAC(LOG_KERN) == facility)) {
+		return false;
+	}
+
+	return true;
+}
+
+static bool _receive_messages(const int fd,
+                              const char *label,
+                              const size_t label_length,
+                              syslogd_t *syslogd) {
+	/* the receiving buffers */
+	static char buffers[BATCH_SIZE][1 + MAX_MESSAGE_LENGTH] = {{'\0'}};
+
+	/* the ancillary data buffers, which receive the sender credentials */
+	static char controls[BATCH_SIZE][CMSG_SPACE(sizeof(struct ucred))] = {
+		{'\0'}
+	};
+
+	/* the buffer descriptors */
+	struct iovec vectors[BATCH_SIZE] = {{0}};
+	struct mmsghdr messages[BATCH_SIZE] = {{{0}}};
+
+	/* the time messages were received */
+	struct timespec now = {0};
+
+	/* a control message */
+	struct cmsghdr *control = NULL;
+
+	/* a loop index */
+	int i = 0;
+
+	/* the number of received messages */
+	int count = 0;
+
+	assert(NULL != syslogd);
+
+	for ( ; BATCH_SIZE > i; ++i) {
+		vectors[i].iov_base = buffers[i];
+		vectors[i].iov_len = sizeof(buffers[i]) - 1;
+		messages[i].msg_hdr.msg_iov = &vectors[i];
+		messages[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	do {
+		/* receive all queued messages */
+		for (i = 0; BATCH_SIZE > i; ++i) {
+			messages[i].msg_hdr.msg_control = controls[i];
+			messages[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+		}
+		count = recvmmsg(fd, messages, BATCH_SIZE, MSG_DONTWAIT, NULL);
+		if (-1 == count) {
+			if (EAGAIN != errno) {
+				return false;
+			}
+			return true;
+		}
+
+		if (-1 == clock_gettime(CLOCK_MONOTONIC, &now)) {
+			return false;
+		}
 
+		/* pass them to the writing thread, unless their senders exceed the
+		 * rate limit; if the ring is full, messages are dropped */
+		for (i = 0; count > i; ++i) {
+			if (0 == messages[i].msg_len) {
+				continue;
+			}
+			control = CMSG_FIRSTHDR(&messages[i].msg_hdr);
+			if ((true == _is_limited(buffers[i],
+			                         (size_t) messages[i].msg_len,
+			                         control)) &&
+			    (false == limit_take(&syslogd->limit,
+			                         (const struct ucred *)
+			                         CMSG_DATA(control),
+			                         &now))) {
+				continue;
+			}
+			(void) ring_push(&syslogd->ring,
+			                 buffers[i],
+			                 (size_t) messages[i].msg_len,
+			                 label,
+			                 label_length);
+		}
+		ring_notify(&syslogd->ring);
+	} while (1);
+}
+
+static int _listen(const char *path) {
 	/* the Unix socket address */
-	struct sockaddr_un unix_address = {0};
+	struct sockaddr_un address = {0};
+
+	/* a flag which enables passing of sender credentials */
+	int is_enabled = 1;
+
+	/* the socket */
+	int fd = -1;
+
+	assert(NULL != path);
+
+	if (sizeof(address.sun_path) <= strlen(path)) {
+		return -1;
+	}
+
+	/* create a Unix socket */
+	fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+	if (-1 == fd) {
+		return -1;
+	}
+
+	/* receive the credentials of senders with their messages */
+	if (-1 == setsockopt(fd,
+	                     SOL_SOCKET,
+	                     SO_PASSCRED,
+	                     &is_enabled,
+	                     sizeof(is_enabled))) {
+		goto close_socket;
+	}
+
+	/* bind the socket */
+	address.sun_family = AF_UNIX;
+	(void) strcpy(address.sun_path, path);
+	if (-1 == bind(fd, (struct sockaddr *) &address, sizeof(address))) {
+		goto close_socket;
+	}
+
+	return fd;
+
+close_socket:
+	(void) close(fd);
+	return -1;
+}
+
+static bool _parse_source(char *value, source_t *source) {
+	/* the separator between the path and the label */
+	char *separator = NULL;
+
+	assert(NULL != value);
+	assert(NULL != source);
+
+	/* the label follows the last separator, so the path may contain one */
+	separator = strrchr(value, SOURCE_SEPARATOR);
+	if ((NULL == separator) || (value == separator)) {
+		return false;
+	}
+	*separator = '\0';
+
+	/* the label becomes part of the tag, so it cannot contain characters
+	 * which end it */
+	source->label = 1 + separator;
+	source->label_length = strcspn(source->label, " [:");
+	if ((0 == source->label_length) ||
+	    (MAX_LABEL_LENGTH < source->label_length) ||
+	    ('\0' != source->label[source->label_length])) {
+		return false;
+	}
+	source->path = value;
+	source->fd = -1;
+
+	return true;
+}
+
+static void _report_suppressed(syslogd_t *syslogd) {
+	/* a report of suppressed messages */
+	char report[128] = {'\0'};
+
+	assert(NULL != syslogd);
+
+	/* report all senders which exceeded the rate limit */
+	if (true == limit_report(&syslogd->limit, report, sizeof(report))) {
+		do {
+			(void) ring_push(&syslogd->ring,
+			                 report,
+			                 strlen(report),
+			                 NULL,
+			                 0);
+		} while (true == limit_report(&syslogd->limit,
+		                              report,
+		                              sizeof(report)));
+		ring_notify(&syslogd->ring);
+	}
+}
+
+static bool _write_message(syslogd_t *syslogd, const message_t *message) {
+	/* publish the message in the shared ring first, so it can be read even
+	 * if the process crashes before it is written */
+	mirror_publish(&syslogd->mirror, message->text, message->length);
+
+	/* forward the message to the collector; this never blocks, so a slow
+	 * network does not delay the log */
+	if ((true == syslogd->is_forwarding) &&
+	    (false == forwarder_forward(&syslogd->forwarder, message))) {
+		return false;
+	}
+
+	/* write the message to the log its facility, priority and tag are routed
+	 * to, immediately if it is urgent, and sync it soon if it must be
+	 * durable */
+	return writer_write(&syslogd->writers[router_route(&syslogd->router,
+	                                                   message)],
+	                    message,
+	                    (URGENT_PRIORITY >= message->priority),
+	                    (syslogd->durable_priority >= message->priority));
+}
+
+static bool _flush_messages(syslogd_t *syslogd) {
+	/* a loop index */
+	unsigned int i = 0;
+
+	/* the return value */
+	bool is_success = true;
+
+	/* write the buffered messages of all logs, even if one fails */
+	for ( ; syslogd->router.destinations > i; ++i) {
+		if (false == writer_flush(&syslogd->writers[i])) {
+			is_success = false;
+		}
+	}
+
+	/* forward buffered messages */
+	if ((true == syslogd->is_forwarding) &&
+	    (false == forwarder_flush(&syslogd->forwarder))) {
+		is_success = false;
+	}
+
+	return is_success;
+}
+
+static bool _is_expired(const struct timespec *timeout) {
+	assert(NULL != timeout);
+
+	return ((0 == timeout->tv_sec) && (0 == timeout->tv_nsec));
+}
+
+static bool _flush_due(syslogd_t *syslogd) {
+	/* the time left until one deadline */
+	struct timespec timeout = {0};
+
+	/* a loop index */
+	unsigned int i = 0;
+
+	/* the return value */
+	bool is_success = true;
+
+	/* write, forward and sync buffered messages whose deadline has passed,
+	 * even if more messages are queued */
+	for ( ; syslogd->router.destinations > i; ++i) {
+		if ((true == writer_get_timeout(&syslogd->writers[i], &timeout)) &&
+		    (true == _is_expired(&timeout)) &&
+		    (false == writer_flush(&syslogd->writers[i]))) {
+			is_success = false;
+		}
+	}
+	if ((true == syslogd->is_forwarding) &&
+	    (true == forwarder_get_timeout(&syslogd->forwarder, &timeout)) &&
+	    (true == _is_expired(&timeout)) &&
+	    (false == forwarder_flush(&syslogd->forwarder))) {
+		is_success = false;
+	}
+
+	return is_success;
+}
+
+static void _min_timeout(struct timespec *timeout,
+                         const struct timespec *other,
+                         bool *is_found) {
+	assert(NULL != timeout);
+	assert(NULL != other);
+	assert(NULL != is_found);
+
+	if ((false == *is_found) ||
+	    (other->tv_sec < timeout->tv_sec) ||
+	    ((other->tv_sec == timeout->tv_sec) &&
+	     (other->tv_nsec < timeout->tv_nsec))) {
+		*timeout = *other;
+		*is_found = true;
+	}
+}
+
+static bool _get_timeout(const syslogd_t *syslogd, struct timespec *timeout) {
+	/* the time left until one deadline */
+	struct timespec other = {0};
+
+	/* a loop index */
+	unsigned int i = 0;
+
+	/* a flag which indicates whether there is a deadline */
+	bool is_found = false;
+
+	/* wait until buffered messages of any log must be written or forwarded,
+	 * or repeated messages must be reported, whichever comes first */
+	for ( ; syslogd->router.destinations > i; ++i) {
+		if (true == writer_get_timeout(&syslogd->writers[i], &other)) {
+			_min_timeout(timeout, &other, &is_found);
+		}
+	}
+	if ((true == syslogd->is_forwarding) &&
+	    (true == forwarder_get_timeout(&syslogd->forwarder, &other))) {
+		_min_timeout(timeout, &other, &is_found);
+	}
+	if (true == dedup_get_timeout(&syslogd->dedup, &other)) {
+		_min_timeout(timeout, &other, &is_found);
+	}
+
+	return is_found;
+}
+
+static void *_write_messages(void *arg) {
+	/* the daemon state */
+	syslogd_t *syslogd = (syslogd_t *) arg;
+
+	/* a message */
+	message_t *message = NULL;
+
+	/* a report of repeated messages */
+	message_t report = {{0}};
+
+	/* the time left until buffered messages must be written */
+	struct timespec timeout = {0};
+
+	/* a flag which indicates whether the receiving thread has stopped */
+	bool is_closed = false;
+
+	/* the number of messages written since deadlines were checked */
+	unsigned int written = 0;
+
+	/* a flag which indicates whether repeated messages were reported */
+	bool is_reported = false;
+
+	assert(NULL != syslogd);
+
+	do {
+		/* check whether more messages may arrive, before checking for
+		 * messages, so none are left behind */
+		is_closed = ring_is_closed(&syslogd->ring);
+
+		/* write the next message to the log, unless it repeats the previous
+		 * message of the same source; in that case, it is only counted */
+		message = ring_peek(&syslogd->ring);
+		if (NULL != message) {
+			if (false == dedup_is_repeated(&syslogd->dedup,
+			                               message,
+			                               &report,
+			                               &is_reported)) {
+				if (((true == is_reported) &&
+				     (false == _write_message(syslogd, &report))) ||
+				    (false == _write_message(syslogd, message))) {
+					goto failure;
+				}
+			}
+			ring_pop(&syslogd->ring);
+
+			/* check the deadlines every batch of messages, so steady
+			 * traffic does not delay them */
+			++written;
+			if (BATCH_SIZE > written) {
+				continue;
+			}
+		}
+
+		/* once the ring is drained, or after a batch of messages, write,
+		 * forward and sync messages whose deadline has passed */
+		if (0 < written) {
+			written = 0;
+			if (false == _flush_due(syslogd)) {
+				goto failure;
+			}
+			if (NULL != message) {
+				continue;
+			}
+		}
+
+		if (true == is_closed) {
+			break;
+		}
+
+		/* report messages repeated for a while */
+		while (true == dedup_expire(&syslogd->dedup, &report, false)) {
+			if (false == _write_message(syslogd, &report)) {
+				goto failure;
+			}
+		}
+
+		/* wait for more messages or, if messages are buffered or repeated
+		 * messages were not reported yet, until they must be written */
+		if (true == _get_timeout(syslogd, &timeout)) {
+			if (false == ring_wait(&syslogd->ring, &timeout)) {
+				if (false == _flush_messages(syslogd)) {
+					goto failure;
+				}
+			}
+		} else {
+			if (false == ring_wait(&syslogd->ring, NULL)) {
+				goto failure;
+			}
+		}
+	} while (1);
+
+	/* report all repeated messages and write all buffered messages */
+	while (true == dedup_expire(&syslogd->dedup, &report, true)) {
+		if (false == _write_message(syslogd, &report)) {
+			goto failure;
+		}
+	}
+	if (false == _flush_messages(syslogd)) {
+		goto failure;
+	}
+
+	return arg;
+
+failure:
+	/* stop the receiving thread */
+	(void) kill(getpid(), SIGTERM);
+	return NULL;
+}
+
+int main(int argc, char *argv[]) {
+	/* the daemon state */
+	static syslogd_t syslogd = {{{{{0}}}}};
+
+	/* additional sockets */
+	source_t sources[MAX_SOURCES] = {{0}};
+
+	/* the collector messages are forwarded to */
+	char *collector = NULL;
+
+	/* the time left until the next report of suppressed messages */
+	struct timespec timeout = {REPORT_INTERVAL, 0};
+
+	/* the time of the next report of suppressed messages */
+	struct timespec report_time = {0};
+
+	/* the current time */
+	struct timespec now = {0};
 
 	/* the daemon data */
 	daemon_t daemon_data = {{{0}}};
 
-	/* the message size */
-	ssize_t size = 0;
+	/* the writing thread */
+	pthread_t writing_thread = {0};
+
+	/* the writing thread return value */
+	void *result = NULL;
 
 	/* a loop index */
-	ssize_t i = 0;
+	unsigned int i = 0;
+
+	/* the number of log files opened */
+	unsigned int opened = 0;
+
+	/* the number of additional sockets */
+	unsigned int source_count = 0;
+
+	/* the number of additional sockets created */
+	unsigned int listening = 0;
 
 	/* the exit code */
 	int exit_code = EXIT_FAILURE;
 
-	/* the log file */
-	int log_file = 0;
-
 	/* a received signal */
 	int received_signal = 0;
 
-	/* make sure the number of command-line arguments is valid */
-	if (1 != argc) {
+	/* the socket a received signal was sent for */
+	int ready_fd = -1;
+
+	/* a command-line option */
+	int option = 0;
+
+	/* the end of a numeric command-line option */
+	char *end = NULL;
+
+	/* the maximum size of a log segment, in kilobytes */
+	long max_size = DEFAULT_MAX_SIZE;
+
+	/* the number of old log segments kept */
+	long segments = DEFAULT_SEGMENTS;
+
+	/* the number of messages per second a process may send */
+	double rate = DEFAULT_RATE;
+
+	/* the number of messages a process may send at once */
+	double burst = DEFAULT_BURST;
+
+	/* the lowest priority of messages written to disk immediately */
+	long durable_priority = DEFAULT_DURABLE_PRIORITY;
+
+	/* a flag which indicates whether to block when the ring is full, instead
+	 * of dropping messages */
+	bool is_blocking = false;
+
+	/* a flag which indicates whether to write records instead of text */
+	bool is_binary = false;
+
+	/* a flag which indicates whether to forward messages over TCP */
+	bool is_stream = false;
+
+	/* a flag which indicates whether to compress old log segments */
+	bool is_compressed = false;
+
+	/* parse the command-line */
+	do {
+		option = getopt(argc, argv, "brs:n:R:B:d:zu:F:t");
+		if (-1 == option) {
+			break;
+		}
+
+		switch (option) {
+			case 'b':
+				is_blocking = true;
+				break;
+
+			case 'r':
+				is_binary = true;
+				break;
+
+			case 's':
+				max_size = strtol(optarg, &end, 10);
+				if ((optarg == end) || ('\0' != *end) || (0 > max_size)) {
+					PRINT(USAGE);
+					goto end;
+				}
+				break;
+
+			case 'n':
+				segments = strtol(optarg, &end, 10);
+				if ((optarg == end) ||
+				    ('\0' != *end) ||
+				    (0 > segments) ||
+				    (UINT_MAX < segments)) {
+					PRINT(USAGE);
+					goto end;
+				}
+				break;
+
+			case 'R':
+				rate = strtod(optarg, &end);
+				if ((optarg == end) || ('\0' != *end) || (0 > rate)) {
+					PRINT(USAGE);
+					goto end;
+				}
+				break;
+
+			case 'B':
+				burst = strtod(optarg, &end);
+				if ((optarg == end) || ('\0' != *end) || (1 > burst)) {
+					PRINT(USAGE);
+					goto end;
+				}
+				break;
+
+			case 'd':
+				durable_priority = strtol(optarg, &end, 10);
+				if ((optarg == end) ||
+				    ('\0' != *end) ||
+				    (-1 > durable_priority) ||
+				    (LOG_DEBUG < durable_priority)) {
+					PRINT(USAGE);
+					goto end;
+				}
+				break;
+
+			case 'z':
+				is_compressed = true;
+				break;
+
+			case 'u':
+				if ((MAX_SOURCES == source_count) ||
+				    (false == _parse_source(optarg,
+				                            &sources[source_count]))) {
+					PRINT(USAGE);
+					goto end;
+				}
+				++source_count;
+				break;
+
+			case 'F':
+				collector = optarg;
+				break;
+
+			case 't':
+				is_stream = true;
+				break;
+
+			default:
+				PRINT(USAGE);
+				goto end;
+		}
+	} while (1);
+	syslogd.durable_priority = (int) durable_priority;
+
+	/* make sure the number of command-line arguments is valid; -t is valid
+	 * only with -F */
+	if ((argc != optind) || ((NULL == collector) && (true == is_stream))) {
 		PRINT(USAGE);
 		goto end;
 	}
 
-	/* open the log file */
-	log_file = open(LOG_FILE_PATH,
-	                O_WRONLY | O_APPEND | O_CREAT,
-	                LOG_FILE_PERMISSIONS);
-	if (-1 == log_file) {
+	/* load the routing rules */
+	if (false == router_load(&syslogd.router, ROUTES_PATH)) {
 		goto end;
 	}
 
-	/* create a Unix socket */
-	daemon_data.fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+	/* open the log files; each has its own buffer, so messages are never
+	 * copied between them */
+	for ( ; syslogd.router.destinations > opened; ++opened) {
+		if (false == writer_open(&syslogd.writers[opened],
+		                         syslogd.router.paths[opened],
+		                         (off_t) max_size * 1024,
+		                         (unsigned int) segments,
+		                         is_binary,
+		                         is_compressed)) {
+			goto close_logs;
+		}
+	}
+
+	/* parse and resolve the collector address; it is resolved again later if
+	 * this fails */
+	if (NULL != collector) {
+		if (false == forwarder_open(&syslogd.forwarder,
+		                            collector,
+		                            is_stream)) {
+			goto close_logs;
+		}
+		syslogd.is_forwarding = true;
+	}
+
+	/* create the shared ring recent messages are published in */
+	if (false == mirror_open(&syslogd.mirror, MIRROR_PATH)) {
+		goto close_forwarder;
+	}
+
+	/* start tracking repeated messages and senders */
+	dedup_init(&syslogd.dedup);
+	limit_init(&syslogd.limit, rate, burst);
+
+	/* create the ring messages are passed through */
+	if (false == ring_init(&syslogd.ring, is_blocking)) {
+		goto close_mirror;
+	}
+
+	/* create the Unix socket */
+	daemon_data.fd = _listen(SOCKET_PATH);
 	if (-1 == daemon_data.fd) {
-		goto close_log;
+		goto destroy_ring;
 	}
 
-	/* bind the socket */
-	unix_address.sun_family = AF_UNIX;
-	(void) strcpy(unix_address.sun_path, SOCKET_PATH);
-	if (-1 == bind(daemon_data.fd,
-	               (struct sockaddr *) &unix_address,
-	               sizeof(unix_address))) {
-		goto close_unix;
+	/* create the additional sockets */
+	for ( ; source_count > listening; ++listening) {
+		sources[listening].fd = _listen(sources[listening].path);
+		if (-1 == sources[listening].fd) {
+			goto close_sources;
+		}
 	}
 
 	/* initialize the daemon */
 	if (false == daemon_init(&daemon_data, DAEMON_WORKING_DIRECTORY, NULL)) {
-		goto close_unix;
+		goto close_sources;
+	}
+
+	/* receive messages from all sockets, with the same signal */
+	for (i = 0; source_count > i; ++i) {
+		if (false == daemon_watch(&daemon_data, sources[i].fd)) {
+			goto close_sources;
+		}
+	}
+
+	/* schedule the first report of suppressed messages */
+	if (-1 == clock_gettime(CLOCK_MONOTONIC, &report_time)) {
+		goto close_sources;
+	}
+	report_time.tv_sec += REPORT_INTERVAL;
+
+	/* start resolving the collector address in the background, once the
+	 * signal mask is set and the process is a daemon */
+	if ((true == syslogd.is_forwarding) &&
+	    (false == forwarder_start(&syslogd.forwarder))) {
+		goto close_sources;
+	}
+
+	/* start the writing thread, so disk I/O does not block the socket; it
+	 * inherits the signal mask, so signals are received only here */
+	if (0 != pthread_create(&writing_thread,
+	                        NULL,
+	                        _write_messages,
+	                        &syslogd)) {
+		goto close_sources;
 	}
 
 	do {
-		/* wait for a message */
-		if (false == daemon_wait(&daemon_data, &received_signal)) {
+		/* wait for a message, or until suppressed messages must be
+		 * reported */
+		if (false == daemon_timed_wait(&daemon_data,
+		                               &received_signal,
+		                               &timeout,
+		                               &ready_fd)) {
 			break;
 		}
 
-		/* if the received signal is a termination one, report success */
+		/* if the received signal is a termination one, stop */
 		if (SIGTERM == received_signal) {
 			exit_code = EXIT_SUCCESS;
 			break;
 		}
 
-		/* receive a log message */
-		size = recvfrom(daemon_data.fd,
-		                message,
-		                (sizeof(message) - 2),
-		                0,
-		                NULL,
-		                NULL);
-		switch (size) {
-			case (-1):
-				if (EAGAIN != errno) {
-					goto close_unix;
-				}
-
-				/* fall through */
-
-			case 0:
-				continue;
+		/* receive all queued log messages from the socket the signal was
+		 * sent for; if the real-time signal queue overflowed, or the wait
+		 * timed out, the signal does not tell which sockets have messages,
+		 * so all are drained */
+		if (((-1 == ready_fd) || (daemon_data.fd == ready_fd)) &&
+		    (false == _receive_messages(daemon_data.fd, NULL, 0, &syslogd))) {
+			break;
 		}
-
-		/* make sure the log message ends with a line break */
-		if ('\n' != message[size - 1]) {
-			message[size] = '\n';
-			message[1 + size] = '\0';
-			++size;
+		for (i = 0; source_count > i; ++i) {
+			if (((-1 == ready_fd) || (sources[i].fd == ready_fd)) &&
+			    (false == _receive_messages(sources[i].fd,
+			                                sources[i].label,
+			                                sources[i].label_length,
+			                                &syslogd))) {
+				break;
+			}
 		}
-
-		/* XOR the log message */
-		for (i = 0; size > i; ++i) {
-			message[i] ^= XOR_KEY;
+		if (source_count > i) {
+			break;
 		}
 
-		/* write the message to the log */
-		if (size != write(log_file, message, (size_t) size)) {
+		/* periodically, report messages suppressed by the rate limit */
+		if (-1 == clock_gettime(CLOCK_MONOTONIC, &now)) {
 			break;
 		}
+		if ((now.tv_sec > report_time.tv_sec) ||
+		    ((now.tv_sec == report_time.tv_sec) &&
+		     (now.tv_nsec >= report_time.tv_nsec))) {
+			_report_suppressed(&syslogd);
+			report_time.tv_sec = now.tv_sec + REPORT_INTERVAL;
+			report_time.tv_nsec = now.tv_nsec;
+		}
+		timeout.tv_sec = report_time.tv_sec - now.tv_sec;
+		timeout.tv_nsec = report_time.tv_nsec - now.tv_nsec;
+		if (0 > timeout.tv_nsec) {
+			--timeout.tv_sec;
+			timeout.tv_nsec += 1000000000L;
+		}
 	} while (1);
 
-close_unix:
+	/* stop the writing thread, once it writes all messages; if it failed,
+	 * report failure */
+	ring_close(&syslogd.ring);
+	if ((0 != pthread_join(writing_thread, &result)) || (NULL == result)) {
+		exit_code = EXIT_FAILURE;
+	}
+
+close_sources:
+	/* close and delete the additional sockets */
+	while (0 < listening) {
+		--listening;
+		(void) close(sources[listening].fd);
+		(void) unlink(sources[listening].path);
+	}
+
 	/* close the Unix socket */
 	(void) close(daemon_data.fd);
 
 	/* delete the Unix socket */
 	(void) unlink(SOCKET_PATH);
 
-close_log:
-	/* close the log file */
-	(void) close(log_file);
+destroy_ring:
+	/* destroy the ring */
+	ring_destroy(&syslogd.ring);
+
+close_mirror:
+	/* stop publishing messages; the shared ring is kept */
+	mirror_close(&syslogd.mirror);
+
+close_forwarder:
+	/* stop forwarding */
+	if (true == syslogd.is_forwarding) {
+		forwarder_close(&syslogd.forwarder);
+	}
+
+close_logs:
+	/* close the log files */
+	while (0 < opened) {
+		--opened;
+		writer_close(&syslogd.writers[opened]);
+	}
+
+	/* free the routing rules */
+	router_free(&syslogd.router);
 
 end:
 	return exit_code;
@@ -0,0 +1,778 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+#include <errno.h>
+#include <syslog.h>
+#include <assert.h>
+
+#include "syslog.h"
+#include "codec.h"
+#include "block.h"
+#include "writer.h"
+
+/* the log file permissions */
+#define LOG_FILE_PERMISSIONS (0644)
+
+/* the message written after messages were dropped before the log could be
+ * opened */
+#define DROPPED_MESSAGE \
+	"<%d>syslogd: %u messages were dropped before the system log was opened"
+
+static bool _is_due(const struct timespec *deadline,
+                    const struct timespec *now) {
+	return ((now->tv_sec > deadline->tv_sec) ||
+	        ((now->tv_sec == deadline->tv_sec) &&
+	         (now->tv_nsec >= deadline->tv_nsec)));
+}
+
+static bool _sync(writer_t *writer) {
+	assert(NULL != writer);
+
+	/* make all written messages durable, at once; the index is not synced,
+	 * since it can be rebuilt from the segment */
+	writer->is_sync_pending = false;
+	return (0 == fdatasync(writer->fd));
+}
+
+static bool _get_index_path(char *index_path, const char *path) {
+	return (PATH_MAX > snprintf(index_path,
+	                            PATH_MAX,
+	                            RECORD_INDEX_FORMAT,
+	                            path));
+}
+
+static bool _open_segment(writer_t *writer) {
+	/* the index path */
+	char index_path[PATH_MAX] = {'\0'};
+
+	/* the segment header */
+	char magic[RECORD_MAGIC_SIZE] = {'\0'};
+
+	/* the log file attributes */
+	struct stat attributes = {0};
+
+	/* index flags */
+	int flags = O_WRONLY | O_APPEND | O_CREAT;
+
+	assert(NULL != writer);
+
+	writer->index_fd = -1;
+	writer->records = 0;
+	writer->entries = 0;
+
+	/* open the log file */
+	writer->fd = open(writer->path,
+	                  O_WRONLY | O_APPEND | O_CREAT,
+	                  LOG_FILE_PERMISSIONS);
+	if (-1 == writer->fd) {
+		return false;
+	}
+
+	/* get its size */
+	if (-1 == fstat(writer->fd, &attributes)) {
+		goto close_log;
+	}
+	writer->size = attributes.st_size;
+
+	if (true == writer->is_binary) {
+		/* if the segment is new, write its header and start a new index */
+		if (0 == writer->size) {
+			codec_xor(magic, RECORD_MAGIC, sizeof(magic));
+			if (sizeof(magic) != write(writer->fd, magic, sizeof(magic))) {
+				goto close_log;
+			}
+			writer->size = sizeof(magic);
+			flags |= O_TRUNC;
+		}
+
+		/* open the index; without it, the segment can still be read from
+		 * its beginning */
+		if (true == _get_index_path(index_path, writer->path)) {
+			writer->index_fd = open(index_path, flags, LOG_FILE_PERMISSIONS);
+		}
+	}
+
+	/* allocate all blocks of the segment in advance, without changing its
+	 * size, so appending does not fragment it or change its block map; if the
+	 * file system does not support that, blocks are allocated as usual */
+	if (writer->size < writer->max_size) {
+		(void) fallocate(writer->fd,
+		                 FALLOC_FL_KEEP_SIZE,
+		                 0,
+		                 writer->max_size);
+	}
+
+	return true;
+
+close_log:
+	(void) close(writer->fd);
+	writer->fd = -1;
+	return false;
+}
+
+static bool _shift(const char *old_path, const char *new_path) {
+	/* index paths */
+	char old_index_path[PATH_MAX] = {'\0'};
+	char new_index_path[PATH_MAX] = {'\0'};
+
+	if ((false == _get_index_path(old_index_path, old_path)) ||
+	    (false == _get_index_path(new_index_path, new_path))) {
+		return false;
+	}
+
+	/* rename the segment */
+	if ((-1 == rename(old_path, new_path)) && (ENOENT != errno)) {
+		return false;
+	}
+
+	/* rename its index; if it has none, delete the index of the segment it
+	 * replaces */
+	if (-1 == rename(old_index_path, new_index_path)) {
+		if (ENOENT != errno) {
+			return false;
+		}
+		if ((-1 == unlink(new_index_path)) && (ENOENT != errno)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool _shift_segments(writer_t *writer) {
+	/* segment paths */
+	char old_path[PATH_MAX] = {'\0'};
+	char new_path[PATH_MAX] = {'\0'};
+
+	/* a loop index */
+	unsigned int i = 0;
+
+	assert(NULL != writer);
+
+	/* if no old segments are kept, delete the current one and its index */
+	if (0 == writer->segments) {
+		if ((false == _get_index_path(new_path, writer->path)) ||
+		    ((-1 == unlink(new_path)) && (ENOENT != errno))) {
+			return false;
+		}
+		return (0 == unlink(writer->path));
+	}
+
+	/* shift old segments, overwriting the oldest one */
+	for (i = writer->segments - 1; 0 < i; --i) {
+		if ((sizeof(old_path) <= snprintf(old_path,
+		                                  sizeof(old_path),
+		                                  LOG_SEGMENT_FORMAT,
+		                                  writer->path,
+		                                  i)) ||
+		    (sizeof(new_path) <= snprintf(new_path,
+		                                  sizeof(new_path),
+		                                  LOG_SEGMENT_FORMAT,
+		                                  writer->path,
+		                                  1 + i))) {
+			return false;
+		}
+		if (false == _shift(old_path, new_path)) {
+			return false;
+		}
+	}
+
+	/* turn the current segment into the newest old one */
+	if (sizeof(new_path) <= snprintf(new_path,
+	                                 sizeof(new_path),
+	                                 LOG_SEGMENT_FORMAT,
+	                                 writer->path,
+	                                 1)) {
+		return false;
+	}
+	return _shift(writer->path, new_path);
+}
+
+static bool _delete_extra_segments(const writer_t *writer) {
+	/* segment paths */
+	char path[PATH_MAX] = {'\0'};
+	char index_path[PATH_MAX] = {'\0'};
+
+	/* a loop index */
+	unsigned int i = 0;
+
+	assert(NULL != writer);
+
+	/* if fewer old segments are kept than before, delete the ones past the
+	 * oldest kept one, until one is missing */
+	for (i = 1 + writer->segments; 0 < i; ++i) {
+		if ((sizeof(path) <= snprintf(path,
+		                              sizeof(path),
+		                              LOG_SEGMENT_FORMAT,
+		                              writer->path,
+		                              i)) ||
+		    (false == _get_index_path(index_path, path))) {
+			return false;
+		}
+		if ((-1 == unlink(index_path)) && (ENOENT != errno)) {
+			return false;
+		}
+		if (-1 == unlink(path)) {
+			return (ENOENT == errno);
+		}
+	}
+
+	return true;
+}
+
+static void *_compress(void *arg) {
+	/* the writer */
+	writer_t *writer = (writer_t *) arg;
+
+	assert(NULL != writer);
+
+	/* if compression fails, the segment is kept as it is */
+	(void) block_compress(writer->compressed_path);
+	return NULL;
+}
+
+static void _wait_for_compression(writer_t *writer) {
+	assert(NULL != writer);
+
+	if (true == writer->is_compressing) {
+		(void) pthread_join(writer->compressor, NULL);
+		writer->is_compressing = false;
+	}
+}
+
+static void _start_compression(writer_t *writer) {
+	assert(NULL != writer);
+
+	/* compress the newest old segment in the background, so messages are
+	 * written meanwhile; if this fails, it is kept as it is */
+	if ((false == writer->is_compressed) ||
+	    (0 == writer->segments) ||
+	    (sizeof(writer->compressed_path) <=
+	     snprintf(writer->compressed_path,
+	              sizeof(writer->compressed_path),
+	              LOG_SEGMENT_FORMAT,
+	              writer->path,
+	              1))) {
+		return;
+	}
+	writer->is_compressing = (0 == pthread_create(&writer->compressor,
+	                                              NULL,
+	                                              _compress,
+	                                              writer));
+}
+
+static bool _rotate(writer_t *writer) {
+	assert(NULL != writer);
+
+	/* make durable messages written to the current segment reach the disk,
+	 * then close it */
+	if ((true == writer->is_sync_pending) && (false == _sync(writer))) {
+		return false;
+	}
+	(void) close(writer->fd);
+	writer->fd = -1;
+	if (-1 != writer->index_fd) {
+		(void) close(writer->index_fd);
+		writer->index_fd = -1;
+	}
+
+	/* start a new one; the previous old segment must be compressed before it
+	 * is shifted */
+	_wait_for_compression(writer);
+	if (false == _shift_segments(writer)) {
+		return false;
+	}
+	_start_compression(writer);
+	return _open_segment(writer);
+}
+
+static bool _is_binary(const char *path, bool *is_binary) {
+	/* the segment header */
+	char magic[RECORD_MAGIC_SIZE] = {'\0'};
+
+	/* the log file */
+	int fd = -1;
+
+	/* the header size */
+	ssize_t size = 0;
+
+	/* if the segment does not exist, it can be of any format */
+	fd = open(path, O_RDONLY);
+	if (-1 == fd) {
+		return false;
+	}
+
+	/* if the segment is empty, it can be of any format too */
+	size = read(fd, magic, sizeof(magic));
+	(void) close(fd);
+	if (0 >= size) {
+		return false;
+	}
+
+	codec_xor(magic, magic, (size_t) size);
+	*is_binary = ((sizeof(magic) == size) &&
+	              (0 == memcmp(magic, RECORD_MAGIC, sizeof(magic))));
+	return true;
+}
+
+static bool _open(writer_t *writer) {
+	/* a flag which indicates whether the current segment is made of
+	 * records */
+	bool is_segment_binary = false;
+
+	assert(NULL != writer);
+
+	/* if the current segment is of the other format, start a new one */
+	if ((true == _is_binary(writer->path, &is_segment_binary)) &&
+	    (writer->is_binary != is_segment_binary)) {
+		if (false == _shift_segments(writer)) {
+			return false;
+		}
+	}
+
+	return _open_segment(writer);
+}
+
+static void _drop_early(writer_t *writer, const size_t size) {
+	/* a record header */
+	record_header_t header = {0};
+
+	/* a line break */
+	const char *line_break = NULL;
+
+	/* the size of the dropped messages */
+	size_t offset = 0;
+
+	assert(NULL != writer);
+
+	/* drop the oldest messages, at least the given size of them */
+	while ((size > offset) && (writer->early_length > offset)) {
+		if (true == writer->is_binary) {
+			if (false == record_read_header(writer->early,
+			                                writer->early_length,
+			                                offset,
+			                                &header)) {
+				offset = writer->early_length;
+			} else {
+				offset += sizeof(header) + header.length;
+			}
+		} else {
+			line_break = memchr(&writer->early[offset],
+			                    (char) ('\n' ^ XOR_KEY),
+			                    writer->early_length - offset);
+			if (NULL == line_break) {
+				offset = writer->early_length;
+			} else {
+				offset = 1 + (size_t) (line_break - writer->early);
+			}
+		}
+		++writer->dropped;
+	}
+
+	writer->early_length -= offset;
+	(void) memmove(writer->early,
+	               &writer->early[offset],
+	               writer->early_length);
+}
+
+static bool _flush_early(writer_t *writer) {
+	/* a report of dropped messages */
+	message_t report = {{0}};
+
+	/* the current time */
+	struct timespec now = {0};
+
+	/* the report text */
+	char text[128] = {'\0'};
+
+	/* the free space in the early buffer */
+	size_t free_space = 0;
+
+	/* the size of the header of the current segment */
+	off_t header_size = 0;
+
+	/* the number of bytes written */
+	ssize_t size = 0;
+
+	assert(NULL != writer);
+
+	/* move all buffered messages to the early buffer; if it is full, drop
+	 * a quarter of it at once, from the oldest messages */
+	free_space = sizeof(writer->early) - writer->early_length;
+	if (writer->length > free_space) {
+		_drop_early(writer, writer->length - free_space);
+		free_space = sizeof(writer->early) - writer->early_length;
+		if ((sizeof(writer->early) / 4) > free_space) {
+			_drop_early(writer, (sizeof(writer->early) / 4) - free_space);
+		}
+	}
+	(void) memcpy(&writer->early[writer->early_length],
+	              writer->buffer,
+	              writer->length);
+	writer->early_length += writer->length;
+	writer->length = 0;
+	writer->entries = 0;
+
+	/* try to open the log, once in a while; the log directory may be on a
+	 * file system which is not mounted yet, and inotify does not report
+	 * mounts, so there is no way to wait for that */
+	if (-1 == clock_gettime(CLOCK_MONOTONIC, &now)) {
+		return false;
+	}
+	if ((now.tv_sec < writer->retry.tv_sec) ||
+	    ((now.tv_sec == writer->retry.tv_sec) &&
+	     (now.tv_nsec < writer->retry.tv_nsec))) {
+		return true;
+	}
+	writer->retry.tv_sec = now.tv_sec + WRITER_RETRY_INTERVAL;
+	writer->retry.tv_nsec = now.tv_nsec;
+	if (false == _open(writer)) {
+		return true;
+	}
+
+	/* if the early messages do not fit in the current segment, start a new
+	 * one */
+	if (true == writer->is_binary) {
+		header_size = RECORD_MAGIC_SIZE;
+	}
+	if ((0 < writer->max_size) &&
+	    (header_size < writer->size) &&
+	    (writer->max_size < (writer->size + (off_t) writer->early_length))) {
+		if (false == _rotate(writer)) {
+			return false;
+		}
+	}
+
+	/* write all early messages at once; they are not indexed, so the index
+	 * resumes after them */
+	if (0 < writer->early_length) {
+		size = write(writer->fd, writer->early, writer->early_length);
+		if ((ssize_t) writer->early_length != size) {
+			writer->early_length = 0;
+			return false;
+		}
+		writer->size += size;
+		writer->early_length = 0;
+	}
+
+	/* report dropped messages */
+	if (0 < writer->dropped) {
+		message_init(&report,
+		             text,
+		             (size_t) snprintf(text,
+		                               sizeof(text),
+		                               DROPPED_MESSAGE,
+		                               LOG_SYSLOG | LOG_WARNING,
+		                               writer->dropped));
+		writer->dropped = 0;
+		return writer_write(writer, &report, true, false);
+	}
+
+	return true;
+}
+
+bool writer_open(writer_t *writer,
+                 const char *path,
+                 const off_t max_size,
+                 const unsigned int segments,
+                 const bool is_binary,
+                 const bool is_compressed) {
+	assert(NULL != writer);
+	assert(NULL != path);
+
+	writer->path = path;
+	writer->max_size = max_size;
+	writer->segments = segments;
+	writer->is_binary = is_binary;
+	writer->is_compressed = is_compressed;
+	writer->is_compressing = false;
+	writer->length = 0;
+	writer->early_length = 0;
+	writer->dropped = 0;
+	writer->size = 0;
+	writer->records = 0;
+	writer->entries = 0;
+	writer->is_sync_pending = false;
+
+	/* if the log cannot be opened yet, keep messages in memory until it
+	 * can */
+	(void) _delete_extra_segments(writer);
+	if (false == _open(writer)) {
+		writer->fd = -1;
+		writer->index_fd = -1;
+		if (-1 == clock_gettime(CLOCK_MONOTONIC, &writer->retry)) {
+			return false;
+		}
+		writer->retry.tv_sec += WRITER_RETRY_INTERVAL;
+	}
+
+	return true;
+}
+
+void writer_close(writer_t *writer) {
+	assert(NULL != writer);
+
+	/* write all buffered messages; if the log was not opened yet, make a
+	 * last attempt */
+	if (-1 == writer->fd) {
+		writer->retry.tv_sec = 0;
+		writer->retry.tv_nsec = 0;
+	}
+	(void) writer_flush(writer);
+
+	/* close the log file and its index; durable messages are synced first,
+	 * even if their deadline has not passed yet */
+	if (-1 != writer->fd) {
+		if (true == writer->is_sync_pending) {
+			(void) _sync(writer);
+		}
+		(void) close(writer->fd);
+	}
+	if (-1 != writer->index_fd) {
+		(void) close(writer->index_fd);
+	}
+
+	/* let the newest old segment be compressed */
+	_wait_for_compression(writer);
+}
+
+static bool _write_buffer(writer_t *writer) {
+	/* the number of bytes written */
+	ssize_t size = 0;
+
+	assert(NULL != writer);
+
+	/* write all buffered messages at once */
+	size = write(writer->fd, writer->buffer, writer->length);
+	if ((ssize_t) writer->length != size) {
+		writer->length = 0;
+		writer->entries = 0;
+		return false;
+	}
+	writer->size += size;
+	writer->length = 0;
+
+	/* then, add their index entries, so the index never points past the
+	 * end of the segment; if this fails, stop indexing the segment, since
+	 * the rest of it can be found by reading from the last entry */
+	if ((0 < writer->entries) && (-1 != writer->index_fd)) {
+		size = (ssize_t) (writer->entries * sizeof(writer->index[0]));
+		if (size != write(writer->index_fd, writer->index, (size_t) size)) {
+			(void) close(writer->index_fd);
+			writer->index_fd = -1;
+		}
+	}
+	writer->entries = 0;
+
+	return true;
+}
+
+bool writer_flush(writer_t *writer) {
+	/* the current time */
+	struct timespec now = {0};
+
+	assert(NULL != writer);
+
+	/* if the log was not opened yet, keep the messages in memory */
+	if (-1 == writer->fd) {
+		return _flush_early(writer);
+	}
+
+	if ((0 < writer->length) && (false == _write_buffer(writer))) {
+		return false;
+	}
+
+	/* once durable messages must reach the disk, sync them with all
+	 * messages written before */
+	if (true == writer->is_sync_pending) {
+		if (-1 == clock_gettime(CLOCK_MONOTONIC, &now)) {
+			return false;
+		}
+		if (true == _is_due(&writer->sync_deadline, &now)) {
+			return _sync(writer);
+		}
+	}
+
+	return true;
+}
+
+bool writer_write(writer_t *writer,
+                  const message_t *message,
+                  const bool is_urgent,
+                  const bool is_durable) {
+	/* a record header */
+	record_header_t header = {0};
+
+	/* the current time */
+	struct timespec now = {0};
+
+	/* the size of the header of the current segment */
+	off_t header_size = 0;
+
+	/* the message size, once encoded */
+	size_t size = 0;
+
+	assert(NULL != writer);
+	assert(NULL != message);
+	assert(0 < message->length);
+
+	if (true == writer->is_binary) {
+		header_size = RECORD_MAGIC_SIZE;
+		size = sizeof(header) + message->length;
+	} else {
+		/* make sure the message ends with a line break */
+		size = message->length;
+		if ('\n' != message->text[message->length - 1]) {
+			++size;
+		}
+	}
+	assert(sizeof(writer->buffer) >= size);
+
+	/* if there is no room for the message, make some */
+	if ((sizeof(writer->buffer) - writer->length) < size) {
+		if (false == writer_flush(writer)) {
+			return false;
+		}
+	}
+
+	/* if the message does not fit in the current segment, write buffered
+	 * messages and start a new one; messages are never split between
+	 * segments */
+	if ((-1 != writer->fd) &&
+	    (0 < writer->max_size) &&
+	    (header_size < (writer->size + (off_t) writer->length)) &&
+	    (writer->max_size < (writer->size +
+	                         (off_t) (writer->length + size)))) {
+		if ((false == writer_flush(writer)) || (false == _rotate(writer))) {
+			return false;
+		}
+	}
+
+	/* get the current time */
+	if (-1 == clock_gettime(CLOCK_MONOTONIC, &now)) {
+		return false;
+	}
+
+	/* if the buffer was empty, the message must be written soon */
+	if (0 == writer->length) {
+		writer->deadline.tv_sec = now.tv_sec;
+		writer->deadline.tv_nsec = now.tv_nsec +
+		                           (WRITER_FLUSH_DELAY * 1000000L);
+		if (1000000000L <= writer->deadline.tv_nsec) {
+			++writer->deadline.tv_sec;
+			writer->deadline.tv_nsec -= 1000000000L;
+		}
+	}
+
+	/* if the message must be durable, sync it soon; all messages written
+	 * until then become durable with it */
+	if ((true == is_durable) &&
+	    (-1 != writer->fd) &&
+	    (false == writer->is_sync_pending)) {
+		writer->sync_deadline.tv_sec = now.tv_sec;
+		writer->sync_deadline.tv_nsec = now.tv_nsec +
+		                                (WRITER_SYNC_DELAY * 1000000L);
+		if (1000000000L <= writer->sync_deadline.tv_nsec) {
+			++writer->sync_deadline.tv_sec;
+			writer->sync_deadline.tv_nsec -= 1000000000L;
+		}
+		writer->is_sync_pending = true;
+	}
+
+	if (true == writer->is_binary) {
+		record_init(&header, message);
+
+		/* every few records, point the index at the next one */
+		if (0 == (writer->records % RECORD_INDEX_INTERVAL)) {
+			assert(ARRAY_SIZE(writer->index) > writer->entries);
+			writer->index[writer->entries].realtime = header.realtime;
+			writer->index[writer->entries].offset =
+			                 (uint64_t) writer->size + writer->length;
+			++writer->entries;
+		}
+		++writer->records;
+
+		/* XOR the record header and append it to the buffer */
+		codec_xor(&writer->buffer[writer->length],
+		          (const char *) &header,
+		          sizeof(header));
+		writer->length += sizeof(header);
+	}
+
+	/* XOR the log message and append it to the buffer */
+	codec_xor(&writer->buffer[writer->length],
+	          message->text,
+	          message->length);
+	writer->length += message->length;
+
+	/* in text logs, make sure the message ends with a line break */
+	if ((false == writer->is_binary) &&
+	    ('\n' != message->text[message->length - 1])) {
+		writer->buffer[writer->length] = (char) ('\n' ^ XOR_KEY);
+		++writer->length;
+	}
+
+	/* write urgent messages immediately; otherwise, write the buffer once the
+	 * deadline has passed or it must be synced */
+	if ((true == is_urgent) ||
+	    (true == _is_due(&writer->deadline, &now)) ||
+	    ((true == writer->is_sync_pending) &&
+	     (true == _is_due(&writer->sync_deadline, &now)))) {
+		return writer_flush(writer);
+	}
+
+	return true;
+}
+
+bool writer_get_timeout(const writer_t *writer, struct timespec *timeout) {
+	/* the current time */
+	struct timespec now = {0};
+
+	/* the deadline */
+	const struct timespec *deadline = NULL;
+
+	assert(NULL != writer);
+	assert(NULL != timeout);
+
+	deadline = &writer->deadline;
+
+	/* if the buffer is empty, there is no deadline, unless messages wait
+	 * for the log to be opened or must be synced */
+	if (0 == writer->length) {
+		if (true == writer->is_sync_pending) {
+			deadline = &writer->sync_deadline;
+		} else if ((-1 != writer->fd) || (0 == writer->early_length)) {
+			return false;
+		} else {
+			deadline = &writer->retry;
+		}
+	} else if ((true == writer->is_sync_pending) &&
+	           (true == _is_due(&writer->sync_deadline, deadline))) {
+		deadline = &writer->sync_deadline;
+	}
+
+	/* get the current time */
+	if (-1 == clock_gettime(CLOCK_MONOTONIC, &now)) {
+		timeout->tv_sec = 0;
+		timeout->tv_nsec = 0;
+		return true;
+	}
+
+	/* calculate the time left until the deadline */
+	timeout->tv_sec = deadline->tv_sec - now.tv_sec;
+	timeout->tv_nsec = deadline->tv_nsec - now.tv_nsec;
+	if (0 > timeout->tv_nsec) {
+		--timeout->tv_sec;
+		timeout->tv_nsec += 1000000000L;
+	}
+	if (0 > timeout->tv_sec) {
+		timeout->tv_sec = 0;
+		timeout->tv_nsec = 0;
+	}
+
+	return true;
+}
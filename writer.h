@@ -0,0 +1,76 @@
+#ifndef _WRITER_H_INCLUDED
+#	define _WRITER_H_INCLUDED
+
+#	include <stdbool.h>
+#	include <sys/types.h>
+#	include <time.h>
+#	include <limits.h>
+#	include <pthread.h>
+
+#	include "message.h"
+#	include "record.h"
+
+/* the size of the buffer messages are accumulated in */
+#	define WRITER_BUFFER_SIZE (64 * 1024)
+
+/* the maximum number of index entries added to a full buffer */
+#	define WRITER_INDEX_SIZE \
+	(1 + (WRITER_BUFFER_SIZE / \
+	      (RECORD_INDEX_INTERVAL * sizeof(record_header_t))))
+
+/* the maximum time, in milliseconds, a message may wait in the buffer */
+#	define WRITER_FLUSH_DELAY (100)
+
+/* the maximum time, in milliseconds, until durable messages are synced; all
+ * messages written until then share the same sync */
+#	define WRITER_SYNC_DELAY (5)
+
+/* the size of the buffer messages are kept in until the log can be opened */
+#	define WRITER_EARLY_SIZE (256 * 1024)
+
+/* the interval, in seconds, between attempts to open the log */
+#	define WRITER_RETRY_INTERVAL (1)
+
+typedef struct {
+	struct timespec deadline;
+	struct timespec retry;
+	struct timespec sync_deadline;
+	pthread_t compressor;
+	const char *path;
+	off_t size;
+	off_t max_size;
+	size_t length;
+	size_t early_length;
+	size_t entries;
+	unsigned int segments;
+	unsigned int records;
+	unsigned int dropped;
+	int fd;
+	int index_fd;
+	bool is_binary;
+	bool is_sync_pending;
+	bool is_compressed;
+	bool is_compressing;
+	char compressed_path[PATH_MAX];
+	record_index_entry_t index[WRITER_INDEX_SIZE];
+	char buffer[WRITER_BUFFER_SIZE];
+	char early[WRITER_EARLY_SIZE];
+} writer_t;
+
+bool writer_open(writer_t *writer,
+                 const char *path,
+                 const off_t max_size,
+                 const unsigned int segments,
+                 const bool is_binary,
+                 const bool is_compressed);
+void writer_close(writer_t *writer);
+
+bool writer_write(writer_t *writer,
+                  const message_t *message,
+                  const bool is_urgent,
+                  const bool is_durable);
+bool writer_flush(writer_t *writer);
+
+bool writer_get_timeout(const writer_t *writer, struct timespec *timeout);
+
+#endif